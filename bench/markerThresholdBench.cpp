@@ -0,0 +1,300 @@
+// benchmark of the binarization step of MarkerDetector, Gaussian vs mean threshold, and of
+// the pyramid levels and tracking mode against the level-0 full scan
+// build from the repository root, e.g.
+//   g++ -O2 -I. bench/markerThresholdBench.cpp markerDetector.cpp marker.cpp framePool.cpp cvCamera.cpp timer.cpp `pkg-config --cflags --libs opencv` -o markerThresholdBench
+// usage: markerThresholdBench [frames [image ...]]
+// without images, 1920x1080 frames are made by warping data/marker_origin.png into a
+// lit, noisy background at random poses, and a sequence of as many frames with the marker
+// drifting slowly for tracking. Given images are used in order for both.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include "markerDetector.h"
+#include "marker.h"
+#include "cvCamera.h"
+#include "timer.h"
+
+static float uniform(float lo, float hi)
+{
+	return lo + (hi - lo) * (float)rand() / RAND_MAX;
+}
+
+static bool sameImage(const cv::Mat &a, const cv::Mat &b)
+{
+	for (int i = 0; i < a.rows; ++i)
+		if (memcmp(a.ptr<uchar>(i), b.ptr<uchar>(i), a.cols * a.elemSize()) != 0)
+			return false;
+	return true;
+}
+
+// the detector with the refined corners of every marker it finds
+class CornerDetector : public MarkerDetector
+{
+public:
+	CornerDetector(const Camera &calibration, const cv::Size2f &markerRealSize)
+		: MarkerDetector(calibration, markerRealSize)
+	{
+	}
+
+	void detect(const cv::Mat &frame, std::vector<Marker> &markers)
+	{
+		markers.clear();
+		findMarkers(frame, markers);
+	}
+};
+
+// where the marker lands in a frame: its center, size, rotation, a perspective stretch
+// of each corner and the lighting gradient
+struct MarkerPlacement
+{
+	float cx, cy, side, angle, stretch[4], gx, gy;
+};
+
+static MarkerPlacement randomPlacement(cv::Size size)
+{
+	MarkerPlacement p;
+	p.gx = uniform(-0.08f, 0.08f);
+	p.gy = uniform(-0.08f, 0.08f);
+	p.side = uniform(120, 500);
+	p.cx = uniform(p.side, size.width - p.side);
+	p.cy = uniform(p.side, size.height - p.side);
+	p.angle = uniform(0, (float)CV_PI * 2);
+	for (int k = 0; k < 4; ++k)
+		p.stretch[k] = uniform(0.8f, 1.2f);
+	return p;
+}
+
+// the marker placed over a lighting gradient, with sensor noise
+static cv::Mat syntheticFrame(const cv::Mat &marker, cv::Size size, const MarkerPlacement &p)
+{
+	cv::Mat frame(size, CV_8UC3);
+	for (int i = 0; i < size.height; ++i)
+	{
+		cv::Vec3b *row = frame.ptr<cv::Vec3b>(i);
+		for (int j = 0; j < size.width; ++j)
+			row[j] = cv::Vec3b::all(cv::saturate_cast<uchar>(140 + p.gx * (j - size.width / 2) + p.gy * (i - size.height / 2)));
+	}
+
+	cv::Point2f src[4] = { cv::Point2f(0, 0), cv::Point2f((float)marker.cols, 0),
+		cv::Point2f((float)marker.cols, (float)marker.rows), cv::Point2f(0, (float)marker.rows) };
+	cv::Point2f dst[4];
+	for (int k = 0; k < 4; ++k)
+	{
+		float a = p.angle + k * (float)CV_PI / 2;
+		float r = p.side * 0.7f * p.stretch[k];
+		dst[k] = cv::Point2f(p.cx + r * cos(a), p.cy + r * sin(a));
+	}
+	cv::Mat H = cv::getPerspectiveTransform(src, dst);
+	cv::warpPerspective(marker, frame, H, size, cv::INTER_LINEAR, cv::BORDER_TRANSPARENT);
+
+	// sensor noise
+	for (int i = 0; i < size.height; ++i)
+	{
+		uchar *row = frame.ptr<uchar>(i);
+		for (int j = 0; j < size.width * 3; ++j)
+			row[j] = cv::saturate_cast<uchar>(row[j] + rand() % 13 - 6);
+	}
+	return frame;
+}
+
+// frames of one marker drifting, turning and scaling a little from frame to frame
+static void syntheticSequence(const cv::Mat &marker, cv::Size size, int count, std::vector<cv::Mat> &frames)
+{
+	MarkerPlacement p = randomPlacement(size);
+	p.side = uniform(150, 350);
+	p.cx = size.width * 0.5f;
+	p.cy = size.height * 0.5f;
+	float vx = uniform(-8, 8), vy = uniform(-8, 8), turn = uniform(-0.02f, 0.02f), grow = uniform(0.995f, 1.005f);
+	for (int i = 0; i < count; ++i)
+	{
+		frames.push_back(syntheticFrame(marker, size, p));
+		if (p.cx + vx < p.side || p.cx + vx > size.width - p.side)
+			vx = -vx;
+		if (p.cy + vy < p.side || p.cy + vy > size.height - p.side)
+			vy = -vy;
+		p.cx += vx;
+		p.cy += vy;
+		p.angle += turn;
+		p.side = std::min(std::max(p.side * grow, 120.0f), size.height * 0.4f);
+	}
+}
+
+// runs the detector over the frames, the markers of each frame are kept. Returns ms per frame.
+static double detectAll(CornerDetector &detector, const std::vector<cv::Mat> &frames,
+	std::vector<std::vector<Marker> > &markers)
+{
+	markers.resize(frames.size());
+	Timer t;
+	t.start();
+	for (size_t i = 0; i < frames.size(); ++i)
+		detector.detect(frames[i], markers[i]);
+	t.stop();
+	return t.getElapsedTimeInMilliSec() / frames.size();
+}
+
+// detection rate and corner error of the markers against the reference markers of the same
+// frames, a marker counts as found when it has the id of a reference marker
+static void printComparison(const char *name, double ms, const std::vector<std::vector<Marker> > &reference,
+	const std::vector<std::vector<Marker> > &markers)
+{
+	int total = 0, found = 0, corners = 0, farCorners = 0;
+	double errorSum = 0, errorMax = 0;
+	for (size_t i = 0; i < reference.size(); ++i)
+	{
+		for (size_t r = 0; r < reference[i].size(); ++r)
+		{
+			const Marker &ref = reference[i][r];
+			++total;
+			for (size_t m = 0; m < markers[i].size(); ++m)
+			{
+				if (markers[i][m].m_id != ref.m_id)
+					continue;
+				++found;
+				for (int c = 0; c < 4; ++c)
+				{
+					cv::Point2f d = markers[i][m].m_points[c] - ref.m_points[c];
+					double error = sqrt(d.dot(d));
+					errorSum += error;
+					errorMax = std::max(errorMax, error);
+					++corners;
+					if (error > 0.5)
+						++farCorners;
+				}
+				break;
+			}
+		}
+	}
+	printf("%-20s %8.3f ms, found %d of %d markers, corner error mean %.3f max %.3f px, %d of %d over 0.5 px\n",
+		name, ms, found, total, corners ? errorSum / corners : 0.0, errorMax, farCorners, corners);
+}
+
+int main(int argc, char **argv)
+{
+	int frameCount = argc >= 2 ? atoi(argv[1]) : 50;
+	cv::Size size(1920, 1080);
+
+	std::vector<cv::Mat> frames, sequence;
+	if (argc >= 3)
+	{
+		for (int i = 2; i < argc; ++i)
+		{
+			cv::Mat image = cv::imread(argv[i]);
+			if (image.empty())
+			{
+				printf("can't read %s\n", argv[i]);
+				return 1;
+			}
+			frames.push_back(image);
+		}
+	}
+	else
+	{
+		cv::Mat marker = cv::imread("./data/marker_origin.png");
+		if (marker.empty())
+		{
+			printf("can't read ./data/marker_origin.png, run from the repository root\n");
+			return 1;
+		}
+		srand(1);
+		for (int i = 0; i < frameCount; ++i)
+			frames.push_back(syntheticFrame(marker, size, randomPlacement(size)));
+		syntheticSequence(marker, size, frameCount, sequence);
+	}
+	if (sequence.empty())
+		sequence = frames;
+	size = frames[0].size();
+
+	float fxy = 832.560809f * size.width / 640;
+	Camera cam(fxy, fxy, (size.width - 1) * 0.5f, (size.height - 1) * 0.5f);
+	MarkerDetector detector(cam, cv::Size2f(9.0f, 9.0f));
+
+	printf("%d frames of %dx%d, %d threads\n", (int)frames.size(), size.width, size.height, cv::getNumThreads());
+
+	std::vector<cv::Mat> grays(frames.size());
+	for (size_t i = 0; i < frames.size(); ++i)
+		cv::cvtColor(frames[i], grays[i], CV_BGR2GRAY);
+
+	// the threshold alone, the mean one is checked against OpenCV's own mean threshold
+	Timer t;
+	cv::Mat thresholdImg, reference;
+	t.start();
+	for (size_t i = 0; i < grays.size(); ++i)
+		cv::adaptiveThreshold(grays[i], thresholdImg, 255, cv::ADAPTIVE_THRESH_GAUSSIAN_C, cv::THRESH_BINARY_INV, 7, 7);
+	t.stop();
+	printf("threshold gaussian      %8.3f ms\n", t.getElapsedTimeInMilliSec() / grays.size());
+
+	t.start();
+	for (size_t i = 0; i < grays.size(); ++i)
+		cv::adaptiveThreshold(grays[i], thresholdImg, 255, cv::ADAPTIVE_THRESH_MEAN_C, cv::THRESH_BINARY_INV, 7, 7);
+	t.stop();
+	printf("threshold opencv mean   %8.3f ms\n", t.getElapsedTimeInMilliSec() / grays.size());
+
+	bool same = true;
+	t.start();
+	for (size_t i = 0; i < grays.size(); ++i)
+		MarkerDetector::meanThreshold(grays[i], thresholdImg, 7, 7);
+	t.stop();
+	for (size_t i = 0; i < grays.size(); ++i)
+	{
+		MarkerDetector::meanThreshold(grays[i], thresholdImg, 7, 7);
+		cv::adaptiveThreshold(grays[i], reference, 255, cv::ADAPTIVE_THRESH_MEAN_C, cv::THRESH_BINARY_INV, 7, 7);
+		same = same && sameImage(thresholdImg, reference);
+	}
+	printf("threshold mean          %8.3f ms %s\n", t.getElapsedTimeInMilliSec() / grays.size(),
+		same ? "" : "MISMATCH");
+
+	// the whole detection with each threshold
+	const char *names[] = { "gaussian", "mean" };
+	for (int m = MarkerDetector::THRESHOLD_GAUSSIAN; m <= MarkerDetector::THRESHOLD_MEAN; ++m)
+	{
+		detector.setThresholdMethod((MarkerDetector::ThresholdMethod)m);
+		int detected = 0;
+		t.start();
+		for (size_t i = 0; i < frames.size(); ++i)
+		{
+			detector.processFrame(frames[i]);
+			if (!detector.getTransformations().empty())
+				++detected;
+		}
+		t.stop();
+		printf("processFrame %-9s  %8.3f ms, marker found in %d of %d frames\n", names[m],
+			t.getElapsedTimeInMilliSec() / frames.size(), detected, (int)frames.size());
+	}
+
+	// the pyramid levels against the level-0 full scan, levels from 2 on depend on the
+	// widened cornerSubPix window to bring the scaled corners back onto the level-0 ones
+	std::vector<std::vector<Marker> > fullScan, markers;
+	char name[64];
+	{
+		CornerDetector levelDetector(cam, cv::Size2f(9.0f, 9.0f));
+		double ms = detectAll(levelDetector, frames, fullScan);
+		printComparison("full scan level 0", ms, fullScan, fullScan);
+		for (int level = 1; level <= 3; ++level)
+		{
+			levelDetector.setPyramidLevels(level);
+			ms = detectAll(levelDetector, frames, markers);
+			sprintf(name, "full scan level %d", level);
+			printComparison(name, ms, fullScan, markers);
+		}
+	}
+
+	// tracking over the sequence against the level-0 full scan of every frame
+	{
+		CornerDetector fullDetector(cam, cv::Size2f(9.0f, 9.0f));
+		double ms = detectAll(fullDetector, sequence, fullScan);
+		printComparison("sequence level 0", ms, fullScan, fullScan);
+		for (int level = 0; level <= 2; level += 2)
+		{
+			CornerDetector trackingDetector(cam, cv::Size2f(9.0f, 9.0f));
+			trackingDetector.setPyramidLevels(level);
+			trackingDetector.setTracking(true);
+			ms = detectAll(trackingDetector, sequence, markers);
+			sprintf(name, "tracking level %d", level);
+			printComparison(name, ms, fullScan, markers);
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,124 @@
+// micro-benchmark of the readback conversions in pixelOps
+// build from the repository root, e.g.
+//   g++ -O2 -I. bench/pixelOpsBench.cpp pixelOps.cpp timer.cpp `pkg-config --cflags --libs opencv` -o pixelOpsBench
+// usage: pixelOpsBench [width height iterations]
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "pixelOps.h"
+#include "timer.h"
+
+// the per-pixel loop the renderer used before pixelOps::rgbaToBgr
+static void rgbaToBgrScalar(const unsigned char *src, int width, int height, cv::Mat &dst)
+{
+	for (int i = 0; i < height; ++i)
+	{
+		cv::Vec3b *rptr = dst.ptr<cv::Vec3b>(height - i - 1);
+		for (int j = 0; j < width; ++j)
+		{
+			rptr[j][2] = src[i*width * 4 + 4 * j];
+			rptr[j][1] = src[i*width * 4 + 4 * j + 1];
+			rptr[j][0] = src[i*width * 4 + 4 * j + 2];
+		}
+	}
+}
+
+static bool sameImage(const cv::Mat &a, const cv::Mat &b)
+{
+	for (int i = 0; i < a.rows; ++i)
+		if (memcmp(a.ptr<uchar>(i), b.ptr<uchar>(i), a.cols * a.elemSize()) != 0)
+			return false;
+	return true;
+}
+
+int main(int argc, char **argv)
+{
+	int width = 1920, height = 1080, iterations = 100;
+	if (argc >= 4)
+	{
+		width = atoi(argv[1]);
+		height = atoi(argv[2]);
+		iterations = atoi(argv[3]);
+	}
+
+	std::vector<unsigned char> rgba((size_t)width * height * 4);
+	std::vector<float> depth((size_t)width * height);
+	srand(1);
+	for (size_t i = 0; i < rgba.size(); ++i)
+		rgba[i] = (unsigned char)(rand() & 0xff);
+	for (size_t i = 0; i < depth.size(); ++i)
+		depth[i] = (i % 7 == 0) ? 1.0f : (float)rand() / RAND_MAX;
+
+	printf("%dx%d, %d iterations, cpu simd level %d\n", width, height, iterations, pixelOps::simdLevel());
+
+	Timer t;
+	cv::Mat reference(height, width, CV_8UC3), bgr;
+	t.start();
+	for (int k = 0; k < iterations; ++k)
+		rgbaToBgrScalar(&rgba[0], width, height, reference);
+	t.stop();
+	printf("rgba->bgr scalar loop  %8.3f ms\n", t.getElapsedTimeInMilliSec() / iterations);
+
+	const char *names[] = { "none", "sse2", "ssse3", "f16c", "avx2" };
+	int level = pixelOps::simdLevel();
+	for (int l = pixelOps::SIMD_NONE; l <= level; ++l)
+	{
+		pixelOps::setSimdLimit(l);
+		bgr = cv::Mat::zeros(height, width, CV_8UC3);
+		t.start();
+		for (int k = 0; k < iterations; ++k)
+			pixelOps::rgbaToBgr(&rgba[0], width, height, bgr);
+		t.stop();
+		printf("rgba->bgr %-6s       %8.3f ms %s\n", names[l], t.getElapsedTimeInMilliSec() / iterations,
+			sameImage(reference, bgr) ? "" : "MISMATCH");
+	}
+	pixelOps::setSimdLimit(level);
+
+	// overlay with a model covering the middle third, transparent around it
+	std::vector<unsigned char> overlay(rgba);
+	for (int i = 0; i < height; ++i)
+		for (int j = 0; j < width; ++j)
+			if (i < height / 3 || i >= 2 * height / 3 || j < width / 3 || j >= 2 * width / 3)
+				overlay[((size_t)i * width + j) * 4 + 3] = 0;
+	cv::Mat blended;
+	for (int l = pixelOps::SIMD_NONE; l <= level; ++l)
+	{
+		pixelOps::setSimdLimit(l);
+		bgr = reference.clone();
+		t.start();
+		for (int k = 0; k < iterations; ++k)
+			pixelOps::blendRgba(&overlay[0], width, height, bgr);
+		t.stop();
+		bool same = blended.empty() || sameImage(blended, bgr);
+		if (blended.empty())
+			blended = bgr;
+		printf("blend rgba %-6s      %8.3f ms %s\n", names[l], t.getElapsedTimeInMilliSec() / iterations,
+			same ? "" : "MISMATCH");
+	}
+	pixelOps::setSimdLimit(level);
+
+	// each depth format at every level against the plain loop
+	const char *formats[] = { "window", "float", "uint16", "half" };
+	for (int f = pixelOps::DEPTH_WINDOW; f <= pixelOps::DEPTH_HALF; ++f)
+	{
+		cv::Mat encoded;
+		for (int l = pixelOps::SIMD_NONE; l <= level; ++l)
+		{
+			pixelOps::setSimdLimit(l);
+			cv::Mat dst(height, width, pixelOps::depthType((pixelOps::DepthFormat)f));
+			t.start();
+			for (int k = 0; k < iterations; ++k)
+				pixelOps::encodeDepth(&depth[0], width, height, 1.0f, 1000.0f, (pixelOps::DepthFormat)f, 1000.0f, dst);
+			t.stop();
+			bool same = encoded.empty() || sameImage(encoded, dst);
+			if (encoded.empty())
+				encoded = dst;
+			printf("depth %-6s %-6s    %8.3f ms %s\n", formats[f], names[l], t.getElapsedTimeInMilliSec() / iterations,
+				same ? "" : "MISMATCH");
+		}
+	}
+	pixelOps::setSimdLimit(level);
+
+	return 0;
+}
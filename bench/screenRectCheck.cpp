@@ -0,0 +1,105 @@
+// check of GLRenderer::modelScreenRect() against what GL actually draws, and of the
+// ROI readback built on it against whole frames, for principal points on and off
+// the image center
+// build from the repository root, headless, e.g.
+//   g++ -O2 -I. -DUSE_EGL bench/screenRectCheck.cpp glRenderer.cpp glm.cpp cvCamera.cpp glInfo.cpp pixelOps.cpp `pkg-config --cflags --libs opencv` -lEGL -lGL -lGLU -lglut -o screenRectCheck
+// usage: screenRectCheck [model.obj]
+// prints every pose and returns 1 if a drawn pixel falls outside the rectangle
+// or an ROI frame differs from the same part of the whole frame
+
+#include <cstdio>
+#include <cstring>
+#include "glRenderer.h"
+
+// rows of the ROI image that differ from the whole image at offset
+static int differentRows(const cv::Mat &roi, const cv::Mat &whole, cv::Point offset)
+{
+	int rows = 0;
+	size_t rowSize = roi.cols * roi.elemSize();
+	for (int i = 0; i < roi.rows; ++i)
+		if (memcmp(roi.ptr<uchar>(i), whole.ptr<uchar>(i + offset.y) + offset.x * roi.elemSize(), rowSize) != 0)
+			++rows;
+	return rows;
+}
+
+int main(int argc, char **argv)
+{
+	const char *path = argc >= 2 ? argv[1] : "./data/bunny.obj";
+	GLMmodel *model = glmReadOBJ((char*)path);
+	glmUnitize(model);
+	glmFacetNormals(model);
+	glmVertexNormals(model, 90.0f);
+
+	const int width = 320, height = 240;
+	float principalPoints[][2] = { { 160, 120 }, { 130, 100 }, { 195, 140 }, { 100, 70 } };
+	float poses[][6] = {                            // rx, ry, rz, tx, ty, tz
+		{ 0.3f, 0.5f, 0, 0, 0, 3 }, { 0, 0, 0, 0, 0, 6 }, { 0, 0, 0, 1.2f, 0, 3 },
+		{ 0, 0, 0, -1.3f, 0.4f, 3 }, { 0.2f, -0.4f, 0, 0.5f, 0, 2 }, { 0, 0, 0, 5, 0, 3 } };
+
+	long failures = 0;
+	for (int c = 0; c < 4; ++c)
+	{
+		Camera cam(300, 300, principalPoints[c][0], principalPoints[c][1]);
+		GLRenderer renderer;
+		renderer.init(argc, argv, width, height, 0.1f, 100.0f, cam, model, true);
+		renderer.setDepthFormat(pixelOps::DEPTH_FLOAT);
+
+		for (int k = 0; k < 6; ++k)
+		{
+			float *p = poses[k];
+			renderer.camera.setExtrinsic(p[0], p[1], p[2], p[3], p[4], p[5]);
+			renderer.roiUsed = false;
+			renderer.render();
+			cv::Rect rect = renderer.modelScreenRect();
+
+			// without background only the model has non-zero alpha, rgbaBuffer rows are bottom-up
+			int drawn = 0, outside = 0;
+			for (int i = 0; i < height; ++i)
+			{
+				const GLubyte *row = renderer.rgbaBuffer + (size_t)(height - 1 - i) * width * 4;
+				for (int j = 0; j < width; ++j)
+				{
+					if (row[j * 4 + 3] == 0)
+						continue;
+					++drawn;
+					if (!rect.contains(cv::Point(j, i)))
+						++outside;
+				}
+			}
+
+			// the ROI frame, synchronous and through the PBOs, must be the same part of
+			// the whole frame and cover every drawn depth
+			cv::Mat bgr, depth, pose;
+			renderer.getLatestFrame(bgr, depth);
+			cv::Mat wholeBgr = bgr.clone(), wholeDepth = depth.clone();
+			renderer.roiUsed = true;
+			int rows = 0, lost = 0;
+			for (int async = 0; async < 2; ++async)
+			{
+				if (async)
+					for (int i = 0; i < GLRenderer::PBO_COUNT; ++i)
+						renderer.renderPipelined();
+				else
+					renderer.render();
+				cv::Point offset;
+				renderer.getLatestFrame(bgr, depth, pose, offset);
+				cv::Rect roi(offset.x, offset.y, depth.cols, depth.rows);
+				if (!depth.empty())
+					rows += differentRows(bgr, wholeBgr, offset) + differentRows(depth, wholeDepth, offset);
+				for (int i = 0; i < height; ++i)
+					for (int j = 0; j < width; ++j)
+						if (wholeDepth.at<float>(i, j) != 0 && !roi.contains(cv::Point(j, i)))
+							++lost;
+			}
+
+			failures += outside + rows + lost;
+			printf("cx %5.1f cy %5.1f pose %d  rect %3d,%3d %3dx%3d  drawn %6d outside %d  roi rows %d lost %d\n",
+				principalPoints[c][0], principalPoints[c][1], k, rect.x, rect.y, rect.width, rect.height,
+				drawn, outside, rows, lost);
+		}
+	}
+
+	printf(failures ? "FAILED, %ld pixels or rows\n" : "ok\n", failures);
+	glmDelete(model);
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,53 @@
+#include "framePool.h"
+
+FramePool::FramePool()
+	: next(0)
+{
+}
+
+cv::Mat FramePool::acquire(cv::Size size, int type)
+{
+	// prefer a free buffer that already has the right size, searching round robin
+	// so the buffers are used in turn and a just released one can cool down
+	int freeIndex = -1;
+	for (size_t k = 0; k < buffers.size(); ++k)
+	{
+		size_t i = (next + k) % buffers.size();
+		if (inUse(buffers[i]))
+			continue;
+		if (buffers[i].size() == size && buffers[i].type() == type)
+		{
+			next = i + 1;
+			return buffers[i];
+		}
+		if (freeIndex < 0)
+			freeIndex = (int)i;
+	}
+
+	// reallocate a free buffer of another size, or grow the pool
+	if (freeIndex >= 0)
+	{
+		buffers[freeIndex].create(size, type);
+		next = freeIndex + 1;
+		return buffers[freeIndex];
+	}
+	buffers.push_back(cv::Mat(size, type));
+	next = 0;
+	return buffers.back();
+}
+
+int FramePool::size() const
+{
+	return (int)buffers.size();
+}
+
+// the pool's own header is one reference, any other means the buffer is still used.
+// Other threads only drop references, which can't make a free buffer used again.
+bool FramePool::inUse(const cv::Mat &buffer)
+{
+#if CV_MAJOR_VERSION < 3
+	return buffer.refcount && CV_XADD(buffer.refcount, 0) > 1;
+#else
+	return buffer.u && CV_XADD(&buffer.u->refcount, 0) > 1;
+#endif
+}
@@ -0,0 +1,31 @@
+#ifndef _FRAME_POOL_H_
+#define _FRAME_POOL_H_
+
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+// recycles image buffers across frames instead of allocating new ones every frame.
+// A buffer is handed out again once every cv::Mat sharing it has been released,
+// so images can be passed on to other threads and come back to the pool by themselves.
+// acquire() is called from one thread, the images can be released on any thread.
+class FramePool
+{
+public:
+	FramePool();
+
+	// an image of size and type that nothing outside the pool references.
+	// A buffer is allocated only while all pooled ones are in use or of another size.
+	// The pixels are left from the buffer's previous use.
+	cv::Mat acquire(cv::Size size, int type);
+
+	// number of buffers held by the pool
+	int size() const;
+
+private:
+	static bool inUse(const cv::Mat &buffer);
+
+	std::vector<cv::Mat> buffers;
+	size_t next;                       // where the search for a free buffer starts
+};
+
+#endif
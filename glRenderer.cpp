@@ -1,5 +1,6 @@
 #include "glRenderer.h"
 #include "glm.h"
+#include "pixelOps.h"
 
 using std::stringstream;
 using std::string;
@@ -7,29 +8,19 @@ using std::cout;
 using std::endl;
 using std::ends;
 
-// global variables
-GLuint GLRenderer::fboId;                       // ID of FBO
-GLuint GLRenderer::rboIds[2];                       // ID of Render buffer object
-int GLRenderer::screenWidth;
-int GLRenderer::screenHeight;
-int GLRenderer::renderWidth;
-int GLRenderer::renderHeight;
-bool GLRenderer::fboSupported;
-bool GLRenderer::fboUsed;
-int GLRenderer::drawMode;
-GLMmodel* GLRenderer::model;
-float GLRenderer::modelDimensions[3];
-GLubyte* GLRenderer::rgbaBuffer;
-GLfloat* GLRenderer::depthBuffer;
-cv::Mat GLRenderer::bgrImg;
-cv::Mat GLRenderer::depthMap;
-Camera GLRenderer::camera;
-GLfloat GLRenderer::nearP, GLRenderer::farP;
-
-GLuint GLRenderer::bgImgTextureId;
-bool GLRenderer::bgImgUsed;
-cv::Mat GLRenderer::bgImg;
-GLubyte* GLRenderer::bgImgBuffer;
+// renderer of each GLUT window
+std::map<int, GLRenderer*> GLRenderer::windowRenderers;
+
+// glutInit() may only be called once per process
+static bool glutInitialized = false;
+
+#ifdef USE_EGL
+// the EGL display is shared by all headless renderers of the process,
+// eglTerminate() would destroy the contexts of every renderer, so it is reference counted
+static EGLDisplay sharedEglDisplay = EGL_NO_DISPLAY;
+static int sharedEglDisplayRefs = 0;
+static cv::Mutex sharedEglDisplayMutex;
+#endif
 
 // function pointers for FBO
 // Windows needs to get function pointers from ICD OpenGL drivers,
@@ -51,6 +42,13 @@ PFNGLBINDRENDERBUFFERPROC                    pglBindRenderbuffer = 0;
 PFNGLRENDERBUFFERSTORAGEPROC                 pglRenderbufferStorage = 0;                  // renderbuffer memory allocation procedure
 PFNGLGETRENDERBUFFERPARAMETERIVPROC          pglGetRenderbufferParameteriv = 0;           // return various renderbuffer parameters
 PFNGLISRENDERBUFFERPROC                      pglIsRenderbuffer = 0;                       // determine renderbuffer object type
+// Buffer object (PBO, VBO)
+PFNGLGENBUFFERSPROC                          pglGenBuffers = 0;                           // buffer name generation procedure
+PFNGLDELETEBUFFERSPROC                       pglDeleteBuffers = 0;                        // buffer deletion procedure
+PFNGLBINDBUFFERPROC                          pglBindBuffer = 0;                           // buffer bind procedure
+PFNGLBUFFERDATAPROC                          pglBufferData = 0;                           // buffer memory allocation procedure
+PFNGLMAPBUFFERPROC                           pglMapBuffer = 0;                            // map buffer procedure
+PFNGLUNMAPBUFFERPROC                         pglUnmapBuffer = 0;                          // unmap buffer procedure
 
 #define glGenFramebuffers                        pglGenFramebuffers
 #define glDeleteFramebuffers                     pglDeleteFramebuffers
@@ -67,6 +65,13 @@ PFNGLISRENDERBUFFERPROC                      pglIsRenderbuffer = 0;
 #define glRenderbufferStorage                    pglRenderbufferStorage
 #define glGetRenderbufferParameteriv             pglGetRenderbufferParameteriv
 #define glIsRenderbuffer                         pglIsRenderbuffer
+
+#define glGenBuffers                             pglGenBuffers
+#define glDeleteBuffers                          pglDeleteBuffers
+#define glBindBuffer                             pglBindBuffer
+#define glBufferData                             pglBufferData
+#define glMapBuffer                              pglMapBuffer
+#define glUnmapBuffer                            pglUnmapBuffer
 #endif
 
 // function pointers for WGL_EXT_swap_control
@@ -79,35 +84,415 @@ PFNWGLGETSWAPINTERVALEXTPROC pwglGetSwapIntervalEXT = 0;
 #define wglGetSwapIntervalEXT   pwglGetSwapIntervalEXT
 #endif
 
-void GLRenderer::render()
+GLRenderer::GLRenderer()
 {
-	// the last GLUT call (LOOP)
-	// window will be shown and display callback is triggered by events
-	// NOTE: this call never return main().
-	//glutMainLoop(); /* Start GLUT event-processing loop */
-
-	// the last GLUT call (LOOP)
-	// window will be shown and display callback is triggered by events
-	// NOTE: this call will return main().
-	glutMainLoopEvent();	
-	glutPostRedisplay();
+	fboId = 0;
+	rboIds[0] = rboIds[1] = 0;
+	fboSupported = fboUsed = false;
+	headless = false;
+	windowHandle = 0;
+	renderMode = RENDER_COLOR;
+	depthFormat = pixelOps::DEPTH_WINDOW;
+	depthScale = 1000.0f;
+	model = 0;
+	rgbaBuffer = 0;
+	depthBuffer = 0;
+	depthBufferFrame = -1;
+	bgImgTextureId = 0;
+	bgImgUsed = false;
+	bgPboIds[0] = bgPboIds[1] = 0;
+	bgPboIndex = 0;
+	roiUsed = false;
+	for (int i = 0; i < PBO_COUNT; ++i)
+		pboIds[i][0] = pboIds[i][1] = 0;
+	pboSupported = false;
+	meshVboId = meshIboId = 0;
+	vboSupported = vboUsed = false;
+	atlasFboId = 0;
+	atlasRboIds[0] = atlasRboIds[1] = 0;
+	atlasCols = atlasRows = 0;
+	atlasRgba = 0;
+	atlasDepth = 0;
+
+#ifdef USE_EGL
+	eglDisplay = EGL_NO_DISPLAY;
+	eglContext = EGL_NO_CONTEXT;
+	eglSurface = EGL_NO_SURFACE;
+#endif
+}
+
+GLRenderer::~GLRenderer()
+{
+	// nothing to release if init() was never called
+	if (!headless && !windowHandle)
+		return;
+
+	makeContextCurrent();
+	clearSharedMem();
+
+	if (windowHandle)
+	{
+		windowRenderers.erase(windowHandle);
+		glutDestroyWindow(windowHandle);
+		windowHandle = 0;
+	}
+	clearEGL();
+}
+
+// bind the context of this renderer to the calling thread
+void GLRenderer::makeContextCurrent()
+{
+#ifdef USE_EGL
+	if (headless)
+	{
+		if (eglGetCurrentContext() != eglContext)
+		{
+			eglBindAPI(EGL_OPENGL_API);
+			eglMakeCurrent(eglDisplay, eglSurface, eglSurface, eglContext);
+		}
+		return;
+	}
+#endif
+	if (windowHandle && glutGetWindow() != windowHandle)
+		glutSetWindow(windowHandle);
+}
+
+// unbind the headless context from the calling thread, so another thread can use the renderer
+void GLRenderer::releaseContext()
+{
+#ifdef USE_EGL
+	if (headless && eglGetCurrentContext() == eglContext)
+		eglMakeCurrent(eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+#endif
+}
+
+// draw the current camera pose and bgImg, and read the frame back before returning.
+// Returns the index of the frame now stored in bgrImg/depthMap, it always
+// corresponds to the pose set before this call.
+long GLRenderer::render()
+{
+	// handle pending window events (keyboard, reshape, expose) first.
+	// A redisplay GLUT posts for them only redraws the window through display(),
+	// so the frame below is the only one read back and made ready by this call.
+	if (!headless)
+		glutMainLoopEvent();
+	makeContextCurrent();
+
+	// frames still in flight are older than this one, drop them
+	for (int i = 0; i < PBO_COUNT; ++i)
+		pboFrameIndex[i] = -1;
+
+	drawFrame(false);
+	if (!headless)
+		glutSwapBuffers();
+
+	return readyFrameIndex;
+}
+
+// draw the current camera pose and bgImg, read it into a PBO without waiting,
+// and complete the oldest frame in flight. Returns the index of the frame now stored
+// in bgrImg/depthMap, PBO_COUNT-1 frames behind once the pipeline is full.
+// Until then it is the last frame completed before, -1 if there is none.
+// getLatestFrame() tells which pose the completed frame was drawn with.
+// Falls back to render() if PBO is not supported.
+long GLRenderer::renderPipelined()
+{
+	if (!pboSupported)
+		return render();
+
+	if (!headless)
+		glutMainLoopEvent();
+	makeContextCurrent();
+
+	drawFrame(true);
+	if (!headless)
+		glutSwapBuffers();
+
+	return readyFrameIndex;
+}
+
+// draw the model under each 3x4 camera extrinsic into the tiles of an atlas FBO
+// and read the whole atlas back with one transfer per pass.
+// bgrs[i] and depths[i] are views into the atlas images, valid until the next call.
+// The render mode applies as in getLatestFrame(), bgrs hold masks in mask mode.
+// The camera extrinsic is restored afterwards, the frame getLatestFrame() returns and
+// the frames in flight are left as they are. Without FBO the poses are drawn
+// one by one through drawFrame() and copied out.
+// Returns the number of poses rendered.
+int GLRenderer::renderBatch(const std::vector<cv::Mat> &extrinsics,
+	std::vector<cv::Mat> &bgrs, std::vector<cv::Mat> &depths)
+{
+	int count = (int)extrinsics.size();
+	bgrs.resize(count);
+	depths.resize(count);
+	if (count == 0)
+		return 0;
+
+	if (!headless)
+		glutMainLoopEvent();
+	makeContextCurrent();
+
+	cv::Mat savedExtrinsic = camera.getExtrinsic().clone();
+
+	// without FBO render the poses one by one, as whole images like the atlas.
+	// They pass through the images and depthBuffer of the ready frame, which are
+	// restored afterwards, so like the atlas the batch leaves getLatestFrame(),
+	// unproject() and the frames in flight as they were.
+	if (!fboSupported)
+	{
+		long savedReadyFrameIndex = readyFrameIndex;
+		cv::Mat savedReadyPose = readyPose.clone();
+		cv::Rect savedReadyRect = readyRect;
+		cv::Mat savedBgr, savedDepth;
+		getLatestFrame(savedBgr, savedDepth);
+		savedBgr = savedBgr.clone();
+		savedDepth = savedDepth.clone();
+		long savedDepthBufferFrame = depthBufferFrame;
+		cv::Rect savedDepthBufferRect = depthBufferRect;
+		std::vector<GLfloat> savedDepthBuffer(depthBuffer, depthBuffer + depthBufferRect.area());
+
+		bool savedRoiUsed = roiUsed;
+		roiUsed = false;
+		for (int i = 0; i < count; ++i)
+		{
+			camera.setExtrinsic(extrinsics[i]);
+			drawFrame(false);
+			cv::Mat bgr, depth;
+			getLatestFrame(bgr, depth);
+			bgr.copyTo(bgrs[i]);
+			depth.copyTo(depths[i]);
+		}
+		roiUsed = savedRoiUsed;
+		camera.setExtrinsic(savedExtrinsic);
+
+		readyFrameIndex = savedReadyFrameIndex;
+		savedReadyPose.copyTo(readyPose);
+		readyRect = savedReadyRect;
+		cv::Mat bgr, depth;
+		getLatestFrame(bgr, depth);
+		if (!savedBgr.empty())
+			savedBgr.copyTo(bgr);
+		if (!savedDepth.empty())
+			savedDepth.copyTo(depth);
+		depthBufferFrame = savedDepthBufferFrame;
+		depthBufferRect = savedDepthBufferRect;
+		if (!savedDepthBuffer.empty())
+			memcpy(depthBuffer, &savedDepthBuffer[0], savedDepthBuffer.size() * sizeof(GLfloat));
+		return count;
+	}
+
+	// tiles per pass are limited by the maximum renderbuffer size
+	GLint maxSize = 0;
+	glGetIntegerv(GL_MAX_RENDERBUFFER_SIZE, &maxSize);
+	int maxCols = std::max(1, (int)maxSize / renderWidth);
+	int maxRows = std::max(1, (int)maxSize / renderHeight);
+	int cols = std::min(maxCols, (int)ceil(sqrt((double)count)));
+	int rows = std::min(maxRows, (count + cols - 1) / cols);
+	if (cols > atlasCols || rows > atlasRows)
+		initAtlas(std::max(cols, atlasCols), std::max(rows, atlasRows));
+	int tiles = atlasCols * atlasRows;
+	int width = atlasCols * renderWidth;
+	int height = atlasRows * renderHeight;
+
+	// the same projection for every tile, the viewport selects the tile
+	glBindFramebuffer(GL_FRAMEBUFFER, atlasFboId);
+	const GLfloat *projection = camera.getProjectionIntrinsic(imageWidth, imageHeight, nearP, farP);
+	GLfloat projectionMatrix[16];
+	memcpy(projectionMatrix, projection, sizeof(projectionMatrix));
+
+	// upload the background once for all poses
+	bool drawBg = bgImgUsed && renderMode == RENDER_COLOR;
+	if (drawBg)
+		uploadBgImg();
+
+	for (int first = 0; first < count; first += tiles)
+	{
+		int last = std::min(count, first + tiles);
+
+		glViewport(0, 0, width, height);
+		glClearColor(0, 0, 0, 0);
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+		for (int i = first; i < last; ++i)
+		{
+			// tile rows are counted from the top of the image, GL rows from the bottom
+			int col = (i - first) % atlasCols;
+			int row = (i - first) / atlasCols;
+			glViewport(col * renderWidth, (atlasRows - 1 - row) * renderHeight, renderWidth, renderHeight);
+
+			if (drawBg)
+			{
+				glDisable(GL_DEPTH_TEST);
+				glDepthMask(GL_FALSE);
+				glDisable(GL_LIGHTING);
+				glPushAttrib(GL_POLYGON_BIT);
+				glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+
+				glMatrixMode(GL_PROJECTION);
+				glLoadIdentity();
+				gluOrtho2D(0, renderWidth, 0, renderHeight);
+				glMatrixMode(GL_MODELVIEW);
+				glLoadIdentity();
+				drawBgQuad();
+
+				glPopAttrib();
+				glEnable(GL_DEPTH_TEST);
+				glDepthMask(GL_TRUE);
+				glEnable(GL_LIGHTING);
+			}
+
+			camera.setExtrinsic(extrinsics[i]);
+			glMatrixMode(GL_PROJECTION);
+			glLoadMatrixf(projectionMatrix);
+			glMatrixMode(GL_MODELVIEW);
+			glLoadMatrixf(camera.getModelviewExtrinsic());
+			drawModel();
+		}
+
+		// one transfer for all tiles of the pass
+		int usedRows = (last - first + atlasCols - 1) / atlasCols;
+		int y = (atlasRows - usedRows) * renderHeight;
+		int h = usedRows * renderHeight;
+		glReadBuffer(GL_COLOR_ATTACHMENT0);
+		if (renderMode == RENDER_COLOR)
+			glReadPixels(0, y, width, h, GL_RGBA, GL_UNSIGNED_BYTE, atlasRgba);
+		else if (renderMode == RENDER_MASK)
+			glReadPixels(0, y, width, h, GL_RED, GL_UNSIGNED_BYTE, atlasRgba);
+		if (renderMode != RENDER_MASK)
+			glReadPixels(0, y, width, h, GL_DEPTH_COMPONENT, GL_FLOAT, atlasDepth);
+
+		// flip into the top-down atlas images
+		if (renderMode == RENDER_COLOR)
+		{
+			cv::Mat usedBgr = atlasBgr(cv::Rect(0, 0, width, h));
+			pixelOps::rgbaToBgr(atlasRgba, width, h, usedBgr);
+		}
+		else if (renderMode == RENDER_MASK)
+		{
+			for (int r = 0; r < h; ++r)
+				memcpy(atlasMask.ptr<uchar>(h - r - 1), atlasRgba + (size_t)r * width, width);
+		}
+		if (renderMode != RENDER_MASK)
+		{
+			cv::Mat usedDepth = atlasDepthMap(cv::Rect(0, 0, width, h));
+			pixelOps::encodeDepth(atlasDepth, width, h, nearP, farP, depthFormat, depthScale, usedDepth);
+		}
+
+		// a later pass reuses the atlas, so only the last pass can hand out views
+		for (int i = first; i < last; ++i)
+		{
+			int col = (i - first) % atlasCols;
+			int row = (i - first) / atlasCols;
+			cv::Rect tile(col * renderWidth, row * renderHeight, renderWidth, renderHeight);
+			cv::Mat bgr, depth;
+			if (renderMode == RENDER_COLOR)
+				bgr = atlasBgr(tile);
+			else if (renderMode == RENDER_MASK)
+				bgr = atlasMask(tile);
+			if (renderMode != RENDER_MASK)
+				depth = atlasDepthMap(tile);
+
+			if (last == count)
+			{
+				bgrs[i] = bgr;
+				depths[i] = depth;
+			}
+			else
+			{
+				bgr.copyTo(bgrs[i]);
+				depth.copyTo(depths[i]);
+			}
+		}
+	}
+
+	glViewport(0, 0, renderWidth, renderHeight);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	camera.setExtrinsic(savedExtrinsic);
+
+	return count;
+}
+
+// (re)create the atlas FBO with cols x rows tiles of the render size
+void GLRenderer::initAtlas(int cols, int rows)
+{
+	clearAtlas();
+
+	atlasCols = cols;
+	atlasRows = rows;
+	int width = cols * renderWidth;
+	int height = rows * renderHeight;
+
+	glGenFramebuffers(1, &atlasFboId);
+	glBindFramebuffer(GL_FRAMEBUFFER, atlasFboId);
+	glGenRenderbuffers(2, atlasRboIds);
+	glBindRenderbuffer(GL_RENDERBUFFER, atlasRboIds[0]);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA, width, height);
+	glBindRenderbuffer(GL_RENDERBUFFER, atlasRboIds[1]);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, width, height);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, atlasRboIds[0]);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, atlasRboIds[1]);
+	checkFramebufferStatus();
+
+	atlasRgba = (GLubyte*)malloc((size_t)width * height * 4);
+	atlasDepth = (GLfloat*)malloc((size_t)width * height * sizeof(GLfloat));
+	atlasBgr.create(height, width, CV_8UC3);
+	atlasDepthMap.create(height, width, pixelOps::depthType(depthFormat));
+	atlasMask.create(height, width, CV_8UC1);
+}
+
+void GLRenderer::clearAtlas()
+{
+	if (atlasFboId)
+	{
+		glDeleteFramebuffers(1, &atlasFboId);
+		glDeleteRenderbuffers(2, atlasRboIds);
+	}
+	atlasFboId = 0;
+	atlasRboIds[0] = atlasRboIds[1] = 0;
+	atlasCols = atlasRows = 0;
+
+	free(atlasRgba);
+	free(atlasDepth);
+	atlasRgba = 0;
+	atlasDepth = 0;
+	atlasBgr.release();
+	atlasDepthMap.release();
+	atlasMask.release();
 }
 
 bool GLRenderer::unproject(float pixel_x, float pixel_y, float &X, float &Y, float &Z)
 {
-	GLint viewport[4];
+	GLint viewport[4] = { 0, 0, renderWidth, renderHeight };
 	GLdouble modelview[16];
 	GLdouble projection[16];
 	GLfloat winX, winY, winZ;
 	GLdouble posX, posY, posZ;
 
-	glGetDoublev(GL_MODELVIEW_MATRIX, modelview);
-	glGetDoublev(GL_PROJECTION_MATRIX, projection);
-	glGetIntegerv(GL_VIEWPORT, viewport);
+	// only render() reads the window depth of the ready frame into depthBuffer,
+	// after renderPipelined() or in the mask mode it holds another frame or nothing
+	if (readyFrameIndex < 0 || depthBufferFrame != readyFrameIndex)
+		return false;
 
 	winX = pixel_x;
-	winY = viewport[3] - pixel_y;
-	winZ = depthBuffer[(int)winY*renderWidth + (int)winX];
+	winY = renderHeight - pixel_y;
+
+	int col = (int)winX - depthBufferRect.x;
+	int row = (int)winY - (renderHeight - depthBufferRect.y - depthBufferRect.height);
+	if (col < 0 || row < 0 || col >= depthBufferRect.width || row >= depthBufferRect.height)
+		return false;
+	winZ = depthBuffer[row*depthBufferRect.width + col];
+
+	// the matrices the ready frame was drawn with, GL may hold those of a later draw
+	Camera readyCamera(camera);
+	readyCamera.setExtrinsic(readyPose);
+	const GLfloat *p = readyCamera.getProjectionIntrinsic(imageWidth, imageHeight, nearP, farP);
+	const GLfloat *m = readyCamera.getModelviewExtrinsic();
+	for (int i = 0; i < 16; ++i)
+	{
+		projection[i] = p[i];
+		modelview[i] = m[i];
+	}
 	
 	GLint status = gluUnProject(winX, winY, winZ, modelview, projection, viewport, &posX, &posY, &posZ);
 	X = float(posX);
@@ -122,24 +507,17 @@ void GLRenderer::getRGBABuffer()
 	if (fboUsed)
 	{
 		glReadBuffer(GL_COLOR_ATTACHMENT0);
-		glReadPixels(0, 0, renderWidth, renderHeight, GL_RGBA, GL_UNSIGNED_BYTE, rgbaBuffer);
+		glReadPixels(frameRect.x, renderHeight - frameRect.y - frameRect.height,
+			frameRect.width, frameRect.height, GL_RGBA, GL_UNSIGNED_BYTE, rgbaBuffer);
 	}
 	else
 	{
 		glReadBuffer(GL_BACK);
-		glReadPixels(0, 0, renderWidth, renderHeight, GL_RGBA, GL_UNSIGNED_BYTE, rgbaBuffer);
+		glReadPixels(frameRect.x, renderHeight - frameRect.y - frameRect.height,
+			frameRect.width, frameRect.height, GL_RGBA, GL_UNSIGNED_BYTE, rgbaBuffer);
 	}
 
-	for (int i = 0; i < renderHeight; ++i)
-	{
-		cv::Vec3b *rptr = bgrImg.ptr<cv::Vec3b>(renderHeight - i - 1);
-		for (int j = 0; j < renderWidth; ++j)
-		{
-			rptr[j][2] = rgbaBuffer[i*renderWidth * 4 + 4 * j];
-			rptr[j][1] = rgbaBuffer[i*renderWidth * 4 + 4 * j + 1];
-			rptr[j][0] = rgbaBuffer[i*renderWidth * 4 + 4 * j + 2];
-		}
-	}
+	copyRGBABuffer(rgbaBuffer, frameRect);
 }
 
 void GLRenderer::getDepthBuffer()
@@ -147,38 +525,510 @@ void GLRenderer::getDepthBuffer()
 	if (fboUsed)
 	{
 		glReadBuffer(GL_DEPTH_ATTACHMENT);
-		glReadPixels(0, 0, renderWidth, renderHeight, GL_DEPTH_COMPONENT, GL_FLOAT, depthBuffer);
+		glReadPixels(frameRect.x, renderHeight - frameRect.y - frameRect.height,
+			frameRect.width, frameRect.height, GL_DEPTH_COMPONENT, GL_FLOAT, depthBuffer);
 	}
 	else
 	{
 		glReadBuffer(GL_BACK);
-		glReadPixels(0, 0, renderWidth, renderHeight, GL_DEPTH_COMPONENT, GL_FLOAT, depthBuffer);
+		glReadPixels(frameRect.x, renderHeight - frameRect.y - frameRect.height,
+			frameRect.width, frameRect.height, GL_DEPTH_COMPONENT, GL_FLOAT, depthBuffer);
+	}
+	depthBufferFrame = frameIndex;
+	depthBufferRect = frameRect;
+
+	copyDepthBuffer(depthBuffer, frameRect);
+}
+
+// read the outputs of the render mode synchronously, frameRect only
+void GLRenderer::readPixels()
+{
+	if (frameRect.area() == 0)
+		return;
+
+	if (renderMode == RENDER_COLOR)
+		getRGBABuffer();
+	else if (renderMode == RENDER_MASK)
+		getMaskBuffer();
+
+	if (renderMode != RENDER_MASK)
+		getDepthBuffer();
+}
+
+void GLRenderer::getMaskBuffer()
+{
+	glReadBuffer(fboUsed ? GL_COLOR_ATTACHMENT0 : GL_BACK);
+	glReadPixels(frameRect.x, renderHeight - frameRect.y - frameRect.height,
+		frameRect.width, frameRect.height, GL_RED, GL_UNSIGNED_BYTE, rgbaBuffer);
+
+	copyMaskBuffer(rgbaBuffer, frameRect);
+}
+
+// copy bottom-up mask rows of rect into the top-down maskImg
+void GLRenderer::copyMaskBuffer(const GLubyte *src, const cv::Rect &rect)
+{
+	for (int i = 0; i < rect.height; ++i)
+		memcpy(maskImg.ptr<uchar>(rect.y + rect.height - i - 1) + rect.x, src + i*rect.width, rect.width);
+}
+
+// convert bottom-up RGBA pixels of rect into the top-down bgrImg
+void GLRenderer::copyRGBABuffer(const GLubyte *src, const cv::Rect &rect)
+{
+	cv::Mat roi = bgrImg(rect);
+	pixelOps::rgbaToBgr(src, rect.width, rect.height, roi);
+}
+
+// encode bottom-up depth values of rect into the top-down depthMap
+void GLRenderer::copyDepthBuffer(const GLfloat *src, const cv::Rect &rect)
+{
+	cv::Mat roi = depthMap(rect);
+	pixelOps::encodeDepth(src, rect.width, rect.height, nearP, farP, depthFormat, depthScale, roi);
+}
+
+void GLRenderer::initPBOs()
+{
+	// create PBO_COUNT pairs of pixel buffer objects, one for color and one for depth.
+	// glBufferData with NULL pointer reserves only memory space.
+	for (int i = 0; i < PBO_COUNT; ++i)
+	{
+		glGenBuffers(2, pboIds[i]);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, pboIds[i][0]);
+		glBufferData(GL_PIXEL_PACK_BUFFER, renderWidth * renderHeight * 4, 0, GL_STREAM_READ);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, pboIds[i][1]);
+		glBufferData(GL_PIXEL_PACK_BUFFER, renderWidth * renderHeight * sizeof(GLfloat), 0, GL_STREAM_READ);
+		pboFrameIndex[i] = -1;
 	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	pboIndex = 0;
+}
 
-	for (int i = 0; i < renderHeight; ++i)
+void GLRenderer::clearPBOs()
+{
+	for (int i = 0; i < PBO_COUNT; ++i)
 	{
-		float *rptr = depthMap.ptr<float>(renderHeight - i - 1);
-		for (int j = 0; j < renderWidth; ++j)
+		glDeleteBuffers(2, pboIds[i]);
+		pboIds[i][0] = pboIds[i][1] = 0;
+		pboFrameIndex[i] = -1;
+	}
+}
+
+void GLRenderer::initBgPBOs()
+{
+	// create BG_PBO_COUNT pixel buffer objects for streaming the background image.
+	// the background size doesn't change, so they live as long as the renderer.
+	glGenBuffers(BG_PBO_COUNT, bgPboIds);
+	for (int i = 0; i < BG_PBO_COUNT; ++i)
+	{
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, bgPboIds[i]);
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, imageWidth * imageHeight * 3, 0, GL_STREAM_DRAW);
+	}
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	bgPboIndex = 0;
+}
+
+void GLRenderer::clearBgPBOs()
+{
+	glDeleteBuffers(BG_PBO_COUNT, bgPboIds);
+	bgPboIds[0] = bgPboIds[1] = 0;
+}
+
+// read frameRect of the current frame into a PBO slot without waiting for the transfer,
+// then map the oldest slot, whose transfer had PBO_COUNT-1 frames to complete,
+// and copy its pixels into bgrImg/depthMap (maskImg in mask mode).
+// Frames in flight are dropped when the render mode changes.
+void GLRenderer::readPixelsAsync()
+{
+	bool readColor = renderMode != RENDER_DEPTH;
+	bool readDepth = renderMode != RENDER_MASK;
+	glReadBuffer(fboUsed ? GL_COLOR_ATTACHMENT0 : GL_BACK);
+
+	// glReadPixels() returns immediately when a PBO is bound to GL_PIXEL_PACK_BUFFER.
+	// The rectangle is packed at the start of the PBO.
+	int y = renderHeight - frameRect.y - frameRect.height;
+	if (readColor && frameRect.area() > 0)
+	{
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, pboIds[pboIndex][0]);
+		glReadPixels(frameRect.x, y, frameRect.width, frameRect.height,
+			renderMode == RENDER_MASK ? GL_RED : GL_RGBA, GL_UNSIGNED_BYTE, 0);
+	}
+	if (readDepth && frameRect.area() > 0)
+	{
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, pboIds[pboIndex][1]);
+		glReadPixels(frameRect.x, y, frameRect.width, frameRect.height, GL_DEPTH_COMPONENT, GL_FLOAT, 0);
+	}
+	pboFrameIndex[pboIndex] = frameIndex;
+	camera.getExtrinsic().copyTo(pboPose[pboIndex]);
+	pboRect[pboIndex] = frameRect;
+
+	int oldest = (pboIndex + 1) % PBO_COUNT;
+	if (pboFrameIndex[oldest] >= 0)
+	{
+		// nothing was read for a model out of view
+		const cv::Rect &rect = pboRect[oldest];
+		readColor = readColor && rect.area() > 0;
+		readDepth = readDepth && rect.area() > 0;
+
+		GLubyte *rgba = 0;
+		if (readColor)
+		{
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, pboIds[oldest][0]);
+			rgba = (GLubyte*)glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+			if (rgba)
+			{
+				if (renderMode == RENDER_MASK)
+					copyMaskBuffer(rgba, rect);
+				else
+					copyRGBABuffer(rgba, rect);
+				glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+			}
+		}
+
+		GLfloat *depth = 0;
+		if (readDepth)
+		{
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, pboIds[oldest][1]);
+			depth = (GLfloat*)glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+			if (depth)
+			{
+				copyDepthBuffer(depth, rect);
+				glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+			}
+		}
+
+		if ((rgba || !readColor) && (depth || !readDepth))
+		{
+			readyFrameIndex = pboFrameIndex[oldest];
+			pboPose[oldest].copyTo(readyPose);
+			readyRect = rect;
+		}
+		pboFrameIndex[oldest] = -1;
+	}
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	pboIndex = oldest;
+}
+
+// hand back the most recent completed frame and its frame index,
+// -1 if no frame has completed yet. The returned images share data with the renderer.
+// In mask mode bgr is the 8-bit mask, images the render mode doesn't produce are empty.
+// With roiUsed they are views of the rectangle that was read back, pixels outside it
+// are left from earlier frames, and empty if the model was out of view.
+long GLRenderer::getLatestFrame(cv::Mat &bgr, cv::Mat &depth)
+{
+	if (readyRect.area() == 0)
+	{
+		bgr = cv::Mat();
+		depth = cv::Mat();
+		return readyFrameIndex;
+	}
+
+	if (renderMode == RENDER_COLOR)
+		bgr = bgrImg(readyRect);
+	else if (renderMode == RENDER_MASK)
+		bgr = maskImg(readyRect);
+	else
+		bgr = cv::Mat();
+	depth = renderMode != RENDER_MASK ? depthMap(readyRect) : cv::Mat();
+	return readyFrameIndex;
+}
+
+// select the encoding of depthMap, see pixelOps::DepthFormat.
+// scale is the DEPTH_UINT16 step per model unit.
+void GLRenderer::setDepthFormat(pixelOps::DepthFormat format, float scale)
+{
+	makeContextCurrent();
+
+	// frames in flight would be encoded with the new format but look completed before it
+	for (int i = 0; i < PBO_COUNT; ++i)
+		pboFrameIndex[i] = -1;
+	readyFrameIndex = -1;
+	readyRect = cv::Rect(0, 0, renderWidth, renderHeight);
+
+	depthFormat = format;
+	depthScale = scale;
+	depthMap = cv::Mat::zeros(renderHeight, renderWidth, pixelOps::depthType(depthFormat));
+	clearAtlas();
+}
+
+// select what drawFrame() draws and reads back, and render at scale times the camera
+// image size. The projection is unchanged, a smaller render size only lowers the resolution.
+void GLRenderer::setRenderMode(RenderMode mode, float scale)
+{
+	makeContextCurrent();
+
+	// frames in flight were read with the previous mode or size
+	renderMode = mode;
+	for (int i = 0; i < PBO_COUNT; ++i)
+		pboFrameIndex[i] = -1;
+	readyFrameIndex = -1;
+
+	int width = std::max(1, cvRound(imageWidth * scale));
+	int height = std::max(1, cvRound(imageHeight * scale));
+	if (width == renderWidth && height == renderHeight)
+		return;
+	renderWidth = width;
+	renderHeight = height;
+	frameRect = readyRect = cv::Rect(0, 0, renderWidth, renderHeight);
+
+	// reallocate everything sized by the render resolution
+	if (fboSupported)
+	{
+		glBindRenderbuffer(GL_RENDERBUFFER, rboIds[0]);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA, renderWidth, renderHeight);
+		glBindRenderbuffer(GL_RENDERBUFFER, rboIds[1]);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, renderWidth, renderHeight);
+		glBindRenderbuffer(GL_RENDERBUFFER, 0);
+	}
+
+	free(rgbaBuffer);
+	free(depthBuffer);
+	rgbaBuffer = (GLubyte*)malloc(renderWidth * renderHeight * 4);
+	depthBuffer = (GLfloat*)malloc(renderWidth * renderHeight * 4);
+	depthBufferFrame = -1;
+	bgrImg = cv::Mat::ones(renderHeight, renderWidth, CV_8UC3);
+	depthMap = cv::Mat::zeros(renderHeight, renderWidth, pixelOps::depthType(depthFormat));
+	maskImg = cv::Mat::zeros(renderHeight, renderWidth, CV_8UC1);
+
+	if (pboSupported)
+	{
+		clearPBOs();
+		initPBOs();
+	}
+	clearAtlas();
+
+	glViewport(0, 0, (GLsizei)renderWidth, (GLsizei)renderHeight);
+}
+
+// same as above, pose is the 3x4 camera extrinsic the frame was drawn with
+long GLRenderer::getLatestFrame(cv::Mat &bgr, cv::Mat &depth, cv::Mat &pose)
+{
+	pose = readyPose;
+	return getLatestFrame(bgr, depth);
+}
+
+// same as above, offset is the top-left corner of the returned views in the render image
+long GLRenderer::getLatestFrame(cv::Mat &bgr, cv::Mat &depth, cv::Mat &pose, cv::Point &offset)
+{
+	offset = readyRect.tl();
+	return getLatestFrame(bgr, depth, pose);
+}
+
+// convert the model once into interleaved vertex buffers drawn with glDrawElements()
+// (re)call it after the model vertices, normals or texcoords have been modified
+void GLRenderer::initMesh()
+{
+	clearMesh();
+
+	GLuint mode = meshMode;
+	if (mode & GLM_FLAT && !model->facetnorms)
+		mode &= ~GLM_FLAT;
+	if (mode & GLM_SMOOTH && !model->normals)
+		mode &= ~GLM_SMOOTH;
+	if (mode & GLM_TEXTURE && !model->texcoords)
+		mode &= ~GLM_TEXTURE;
+	if (mode & GLM_FLAT && mode & GLM_SMOOTH)
+		mode &= ~GLM_FLAT;
+	if (mode & GLM_MATERIAL && !model->materials)
+		mode &= ~GLM_MATERIAL;
+	meshMode = mode;
+
+	bool hasNormal = (mode & (GLM_FLAT | GLM_SMOOTH)) != 0;
+	bool hasTexcoord = (mode & GLM_TEXTURE) != 0;
+	int floatsPerVertex = 3 + (hasNormal ? 3 : 0) + (hasTexcoord ? 2 : 0);
+	meshStride = floatsPerVertex * sizeof(GLfloat);
+
+	// a GLM vertex is re-used by every corner referring to the same normal and texcoord,
+	// the combinations already emitted for each GLM vertex are chained through next
+	std::vector<GLuint> head(model->numvertices + 1, (GLuint)-1);
+	std::vector<GLuint> next;
+	std::vector<GLuint> keys;            // (normal, texcoord) index pair of each emitted vertex
+	std::vector<GLfloat> vertices;
+	std::vector<GLuint> indices;
+	next.reserve(model->numtriangles * 3);
+	keys.reserve(model->numtriangles * 6);
+	vertices.reserve(model->numtriangles * 3 * floatsPerVertex);
+	indices.reserve(model->numtriangles * 3);
+
+	GLMgroup *group = model->groups;
+	while (group)
+	{
+		GLuint material = (mode & GLM_MATERIAL) ? group->material : 0;
+		if (group->numtriangles > 0)
+		{
+			// merge consecutive groups sharing a material into one draw call
+			if (meshRanges.empty() || meshRanges.back().material != material)
+			{
+				MeshRange range = { material, (GLuint)indices.size(), 0 };
+				meshRanges.push_back(range);
+			}
+			meshRanges.back().count += group->numtriangles * 3;
+		}
+
+		for (GLuint i = 0; i < group->numtriangles; ++i)
+		{
+			const GLMtriangle &triangle = model->triangles[group->triangles[i]];
+			for (int k = 0; k < 3; ++k)
+			{
+				GLuint v = triangle.vindices[k];
+				GLuint n = 0, t = 0;
+				if (mode & GLM_FLAT)
+					n = triangle.findex;
+				else if (mode & GLM_SMOOTH)
+					n = triangle.nindices[k];
+				if (hasTexcoord)
+					t = triangle.tindices[k];
+
+				GLuint index = head[v];
+				while (index != (GLuint)-1 && (keys[2 * index] != n || keys[2 * index + 1] != t))
+					index = next[index];
+
+				if (index == (GLuint)-1)
+				{
+					index = (GLuint)next.size();
+					next.push_back(head[v]);
+					head[v] = index;
+					keys.push_back(n);
+					keys.push_back(t);
+
+					const GLfloat *p = &model->vertices[3 * v];
+					vertices.insert(vertices.end(), p, p + 3);
+					if (mode & GLM_FLAT)
+					{
+						p = &model->facetnorms[3 * n];
+						vertices.insert(vertices.end(), p, p + 3);
+					}
+					else if (mode & GLM_SMOOTH)
+					{
+						p = &model->normals[3 * n];
+						vertices.insert(vertices.end(), p, p + 3);
+					}
+					if (hasTexcoord)
+					{
+						p = &model->texcoords[2 * t];
+						vertices.insert(vertices.end(), p, p + 2);
+					}
+				}
+				indices.push_back(index);
+			}
+		}
+		group = group->next;
+	}
+
+	glGenBuffers(1, &meshVboId);
+	glBindBuffer(GL_ARRAY_BUFFER, meshVboId);
+	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(GLfloat), vertices.empty() ? 0 : &vertices[0], GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	glGenBuffers(1, &meshIboId);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, meshIboId);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.empty() ? 0 : &indices[0], GL_STATIC_DRAW);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+	std::cout << "Mesh VBO: " << vertices.size() / floatsPerVertex << " vertices, "
+		<< indices.size() / 3 << " triangles, " << meshRanges.size() << " draw calls." << std::endl;
+}
+
+void GLRenderer::clearMesh()
+{
+	if (meshVboId)
+		glDeleteBuffers(1, &meshVboId);
+	if (meshIboId)
+		glDeleteBuffers(1, &meshIboId);
+	meshVboId = meshIboId = 0;
+	meshRanges.clear();
+}
+
+// same output as glmDraw(model, meshMode), one glDrawElements() per material range
+// with geometryOnly set only positions are fed and all ranges are drawn by one call
+void GLRenderer::drawMesh(bool geometryOnly)
+{
+	bool hasNormal = (meshMode & (GLM_FLAT | GLM_SMOOTH)) != 0;
+	bool hasTexcoord = (meshMode & GLM_TEXTURE) != 0;
+	const GLubyte *offset = 0;
+
+	glBindBuffer(GL_ARRAY_BUFFER, meshVboId);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, meshIboId);
+
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glVertexPointer(3, GL_FLOAT, meshStride, offset);
+
+	if (geometryOnly)
+	{
+		if (!meshRanges.empty())
+			glDrawElements(GL_TRIANGLES, meshRanges.back().first + meshRanges.back().count, GL_UNSIGNED_INT, 0);
+
+		glDisableClientState(GL_VERTEX_ARRAY);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+		return;
+	}
+
+	if (meshMode & GLM_MATERIAL)
+		glDisable(GL_COLOR_MATERIAL);
+
+	offset += 3 * sizeof(GLfloat);
+	if (hasNormal)
+	{
+		glEnableClientState(GL_NORMAL_ARRAY);
+		glNormalPointer(GL_FLOAT, meshStride, offset);
+		offset += 3 * sizeof(GLfloat);
+	}
+	if (hasTexcoord)
+	{
+		glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+		glTexCoordPointer(2, GL_FLOAT, meshStride, offset);
+	}
+
+	for (size_t i = 0; i < meshRanges.size(); ++i)
+	{
+		const MeshRange &range = meshRanges[i];
+		if (meshMode & GLM_MATERIAL)
 		{
-			rptr[j] = depthBuffer[i*renderWidth + j];
+			const GLMmaterial &material = model->materials[range.material];
+			glMaterialfv(GL_FRONT_AND_BACK, GL_AMBIENT, material.ambient);
+			glMaterialfv(GL_FRONT_AND_BACK, GL_DIFFUSE, material.diffuse);
+			glMaterialfv(GL_FRONT_AND_BACK, GL_SPECULAR, material.specular);
+			glMaterialf(GL_FRONT_AND_BACK, GL_SHININESS, material.shininess);
 		}
+		glDrawElements(GL_TRIANGLES, range.count, GL_UNSIGNED_INT, (const GLubyte*)0 + range.first * sizeof(GLuint));
 	}
 
+	glDisableClientState(GL_VERTEX_ARRAY);
+	glDisableClientState(GL_NORMAL_ARRAY);
+	glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 }
 
 void GLRenderer::init(int argc, char **argv, int width, int height, float nP, float fP, 
-	Camera &cam, GLMmodel *mdl)
+	Camera &cam, GLMmodel *mdl, bool hl)
 {
 	// init global vars
 	initSharedMem(width, height, nP, fP, cam, mdl);
 
-	// register exit callback
-	atexit(exitCB);
-
-	// init GLUT and GL
-	initGLUT(argc, argv);
+	// init GLUT or EGL, then GL
+	if (hl)
+	{
+#ifdef USE_EGL
+		headless = initEGL();
+		if (!headless)
+		{
+			std::cout << "Cannot create EGL context for headless rendering." << std::endl;
+			exit(1);
+		}
+#else
+		std::cout << "Headless rendering needs USE_EGL, using a GLUT window instead." << std::endl;
+#endif
+	}
+	if (!headless)
+		initGLUT(argc, argv);
 	initGL();
 
+	// no reshape event without a window, set the viewport once
+	if (headless)
+		reshape(screenWidth, screenHeight);
+
 	// get OpenGL info
 	glInfo glInfo;
 	glInfo.getInfo();
@@ -218,6 +1068,40 @@ void GLRenderer::init(int argc, char **argv, int width, int height, float nP, fl
 		}
 	}
 
+	// get pointers to buffer object functions shared by PBO and VBO
+	glGenBuffers = (PFNGLGENBUFFERSPROC)wglGetProcAddress("glGenBuffers");
+	glDeleteBuffers = (PFNGLDELETEBUFFERSPROC)wglGetProcAddress("glDeleteBuffers");
+	glBindBuffer = (PFNGLBINDBUFFERPROC)wglGetProcAddress("glBindBuffer");
+	glBufferData = (PFNGLBUFFERDATAPROC)wglGetProcAddress("glBufferData");
+	glMapBuffer = (PFNGLMAPBUFFERPROC)wglGetProcAddress("glMapBuffer");
+	glUnmapBuffer = (PFNGLUNMAPBUFFERPROC)wglGetProcAddress("glUnmapBuffer");
+	bool bufferFuncsLoaded = glGenBuffers && glDeleteBuffers && glBindBuffer && glBufferData &&
+		glMapBuffer && glUnmapBuffer;
+
+	// check PBO is supported by your video card
+	if (glInfo.isExtensionSupported("GL_ARB_pixel_buffer_object") && bufferFuncsLoaded)
+	{
+		pboSupported = true;
+		std::cout << "Video card supports GL_ARB_pixel_buffer_object." << std::endl;
+	}
+	else
+	{
+		pboSupported = false;
+		std::cout << "Video card does NOT support GL_ARB_pixel_buffer_object." << std::endl;
+	}
+
+	// check VBO is supported by your video card
+	if (glInfo.isExtensionSupported("GL_ARB_vertex_buffer_object") && bufferFuncsLoaded)
+	{
+		vboSupported = vboUsed = true;
+		std::cout << "Video card supports GL_ARB_vertex_buffer_object." << std::endl;
+	}
+	else
+	{
+		vboSupported = vboUsed = false;
+		std::cout << "Video card does NOT support GL_ARB_vertex_buffer_object." << std::endl;
+	}
+
 	// check EXT_swap_control is supported
 	if (glInfo.isExtensionSupported("WGL_EXT_swap_control"))
 	{
@@ -243,20 +1127,45 @@ void GLRenderer::init(int argc, char **argv, int width, int height, float nP, fl
 		fboSupported = fboUsed = false;
 		std::cout << "Video card does NOT support GL_ARB_framebuffer_object." << std::endl;
 	}
+
+	if (glInfo.isExtensionSupported("GL_ARB_pixel_buffer_object"))
+	{
+		pboSupported = true;
+		std::cout << "Video card supports GL_ARB_pixel_buffer_object." << std::endl;
+	}
+	else
+	{
+		pboSupported = false;
+		std::cout << "Video card does NOT support GL_ARB_pixel_buffer_object." << std::endl;
+	}
+
+	if (glInfo.isExtensionSupported("GL_ARB_vertex_buffer_object"))
+	{
+		vboSupported = vboUsed = true;
+		std::cout << "Video card supports GL_ARB_vertex_buffer_object." << std::endl;
+	}
+	else
+	{
+		vboSupported = vboUsed = false;
+		std::cout << "Video card does NOT support GL_ARB_vertex_buffer_object." << std::endl;
+	}
 #endif
 
 	// create a background texture object
 	glGenTextures(1, &bgImgTextureId);
 	glBindTexture(GL_TEXTURE_2D, bgImgTextureId);
 	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	//glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	//glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
 	//glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
 	//glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
 	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
 	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_2D, GL_GENERATE_MIPMAP, GL_TRUE); // automatic mipmap generation included in OpenGL v1.4
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, renderWidth, renderHeight, 0, GL_RGB, GL_UNSIGNED_BYTE, 0);
+	// the video background is drawn at about its own size and replaced every frame,
+	// mipmaps would only cost a rebuild per upload
+	//glTexParameteri(GL_TEXTURE_2D, GL_GENERATE_MIPMAP, GL_TRUE); // automatic mipmap generation included in OpenGL v1.4
+	// storage is allocated once, uploadBgImg() only replaces the pixels
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, imageWidth, imageHeight, 0, GL_BGR, GL_UNSIGNED_BYTE, 0);
 	glBindTexture(GL_TEXTURE_2D, 0);
 
 	if (fboSupported)
@@ -297,6 +1206,23 @@ void GLRenderer::init(int argc, char **argv, int width, int height, float nP, fl
 		glBindFramebuffer(GL_FRAMEBUFFER, 0);
 	}
 
+	// there is no default framebuffer to fall back to
+	if (headless && !fboSupported)
+	{
+		std::cout << "Headless rendering needs GL_ARB_framebuffer_object." << std::endl;
+		exit(1);
+	}
+
+	// create pixel buffer objects for asynchronous readback and background upload
+	if (pboSupported)
+	{
+		initPBOs();
+		initBgPBOs();
+	}
+
+	// upload the model into vertex buffer objects
+	if (vboSupported)
+		initMesh();
 }
 
 int GLRenderer::initGLUT(int argc, char **argv)
@@ -304,8 +1230,12 @@ int GLRenderer::initGLUT(int argc, char **argv)
 	// GLUT stuff for windowing
 	// initialization openGL window.
 	// It must be called before any other GLUT routine.
-	glutInit(&argc, argv);
-	glutInitDisplayMode(GLUT_RGBA | GLUT_DOUBLE | GLUT_DEPTH );   // display mode
+	if (!glutInitialized)
+	{
+		glutInit(&argc, argv);
+		glutInitialized = true;
+	}
+	glutInitDisplayMode(GLUT_RGBA | GLUT_ALPHA | GLUT_DOUBLE | GLUT_DEPTH );   // display mode, alpha for renderOverlay()
 	glutInitWindowSize(screenWidth, screenHeight);              // window size
 	glutInitWindowPosition(100, 100);                           // window location
 
@@ -313,16 +1243,126 @@ int GLRenderer::initGLUT(int argc, char **argv)
 	// Window will not displayed until glutMainLoop() is called
 	// It returns a unique ID.
 	int handle = glutCreateWindow(argv[0]);     // param is the title of window
+	windowHandle = handle;
+	windowRenderers[handle] = this;
 
-	// register GLUT callback functions
-	glutDisplayFunc(displayCB);
-	glutIdleFunc(idleCB);                       // redraw whenever system is idle
+	// register GLUT callback functions of the new window
+	glutDisplayFunc(displayCB);                 // frames are drawn by render(), not on idle
 	glutReshapeFunc(reshapeCB);
 	glutKeyboardFunc(keyboardCB);
 
 	return handle;
 }
 
+#ifdef USE_EGL
+bool GLRenderer::initEGL()
+{
+	sharedEglDisplayMutex.lock();
+	if (sharedEglDisplayRefs == 0)
+	{
+		// prefer the Mesa surfaceless platform, it needs neither X11 nor a GPU
+		// and falls back to llvmpipe software rasterization
+		sharedEglDisplay = EGL_NO_DISPLAY;
+		const char *clientExts = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+		if (clientExts && strstr(clientExts, "EGL_MESA_platform_surfaceless"))
+		{
+			PFNEGLGETPLATFORMDISPLAYEXTPROC eglGetPlatformDisplayEXT =
+				(PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+			if (eglGetPlatformDisplayEXT)
+				sharedEglDisplay = eglGetPlatformDisplayEXT(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, 0);
+		}
+		if (sharedEglDisplay == EGL_NO_DISPLAY)
+			sharedEglDisplay = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+		EGLint major, minor;
+		if (sharedEglDisplay == EGL_NO_DISPLAY || !eglInitialize(sharedEglDisplay, &major, &minor))
+		{
+			sharedEglDisplayMutex.unlock();
+			return false;
+		}
+		std::cout << "EGL " << major << "." << minor << ", " << eglQueryString(sharedEglDisplay, EGL_VENDOR) << std::endl;
+	}
+	++sharedEglDisplayRefs;
+	eglDisplay = sharedEglDisplay;
+	sharedEglDisplayMutex.unlock();
+
+	// desktop GL for the fixed function pipeline, the FBO is the render target
+	// so the config only needs to allow a tiny pbuffer
+	const EGLint configAttribs[] = {
+		EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+		EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8, EGL_ALPHA_SIZE, 8,
+		EGL_DEPTH_SIZE, 24,
+		EGL_NONE
+	};
+	EGLConfig config;
+	EGLint numConfigs = 0;
+	if (!eglChooseConfig(eglDisplay, configAttribs, &config, 1, &numConfigs) || numConfigs < 1 ||
+		!eglBindAPI(EGL_OPENGL_API))
+	{
+		clearEGL();
+		return false;
+	}
+
+	// every renderer has its own context, none of them share objects
+	eglContext = eglCreateContext(eglDisplay, config, EGL_NO_CONTEXT, 0);
+	if (eglContext == EGL_NO_CONTEXT)
+	{
+		clearEGL();
+		return false;
+	}
+
+	// bind without any surface if the driver allows it, otherwise use a 1x1 pbuffer
+	eglSurface = EGL_NO_SURFACE;
+	const char *displayExts = eglQueryString(eglDisplay, EGL_EXTENSIONS);
+	if (!displayExts || !strstr(displayExts, "EGL_KHR_surfaceless_context"))
+	{
+		const EGLint pbufferAttribs[] = { EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE };
+		eglSurface = eglCreatePbufferSurface(eglDisplay, config, pbufferAttribs);
+	}
+	if (!eglMakeCurrent(eglDisplay, eglSurface, eglSurface, eglContext))
+	{
+		clearEGL();
+		return false;
+	}
+
+	return true;
+}
+
+void GLRenderer::clearEGL()
+{
+	if (eglDisplay == EGL_NO_DISPLAY)
+		return;
+
+	releaseContext();
+	if (eglSurface != EGL_NO_SURFACE)
+		eglDestroySurface(eglDisplay, eglSurface);
+	if (eglContext != EGL_NO_CONTEXT)
+		eglDestroyContext(eglDisplay, eglContext);
+
+	sharedEglDisplayMutex.lock();
+	if (--sharedEglDisplayRefs == 0)
+	{
+		eglTerminate(sharedEglDisplay);
+		sharedEglDisplay = EGL_NO_DISPLAY;
+	}
+	sharedEglDisplayMutex.unlock();
+
+	eglDisplay = EGL_NO_DISPLAY;
+	eglContext = EGL_NO_CONTEXT;
+	eglSurface = EGL_NO_SURFACE;
+}
+#else
+bool GLRenderer::initEGL()
+{
+	return false;
+}
+
+void GLRenderer::clearEGL()
+{
+}
+#endif
+
 void GLRenderer::initGL()
 {
 	glShadeModel(GL_SMOOTH);                    // shading mathod: GL_SMOOTH or GL_FLAT
@@ -354,6 +1394,8 @@ bool GLRenderer::initSharedMem(int width, int height, float nP, float fP,
 {
 	screenWidth = width;
 	screenHeight = height;
+	imageWidth = width;
+	imageHeight = height;
 	renderWidth = width;
 	renderHeight = height;
 	nearP = nP;
@@ -361,6 +1403,7 @@ bool GLRenderer::initSharedMem(int width, int height, float nP, float fP,
 
 	model = mdl;
 	glmDimensions(model, modelDimensions);
+	glmBoundingBox(model, modelMin, modelMax);
 
 	camera.copyFrom(cam);
 
@@ -369,16 +1412,51 @@ bool GLRenderer::initSharedMem(int width, int height, float nP, float fP,
 	fboId = 0;
 	rboIds[0] = rboIds[1] = 0;
 	fboSupported = fboUsed = false;
+	headless = false;
+
+#ifdef USE_EGL
+	eglDisplay = EGL_NO_DISPLAY;
+	eglContext = EGL_NO_CONTEXT;
+	eglSurface = EGL_NO_SURFACE;
+#endif
+
+	depthFormat = pixelOps::DEPTH_WINDOW;
+	depthScale = 1000.0f;
 
 	rgbaBuffer = (GLubyte*)malloc(renderWidth * renderHeight * 4);
 	depthBuffer = (GLfloat*)malloc(renderWidth * renderHeight * 4);
 	bgrImg = cv::Mat::ones(renderHeight, renderWidth, CV_8UC3);
-	depthMap = cv::Mat::zeros(renderHeight, renderWidth, CV_32FC1);
+	depthMap = cv::Mat::zeros(renderHeight, renderWidth, pixelOps::depthType(depthFormat));
+	maskImg = cv::Mat::zeros(renderHeight, renderWidth, CV_8UC1);
+	renderMode = RENDER_COLOR;
 
 	bgImgTextureId = 0;
 	bgImgUsed = false;
-	bgImg = cv::Mat::zeros(renderHeight, renderWidth, CV_8UC3);
-	bgImgBuffer = (GLubyte*)malloc(renderWidth * renderHeight * 3);
+	bgImg = cv::Mat::zeros(imageHeight, imageWidth, CV_8UC3);
+	bgPboIds[0] = bgPboIds[1] = 0;
+	bgPboIndex = 0;
+	roiUsed = false;
+	frameRect = cv::Rect(0, 0, renderWidth, renderHeight);
+
+	for (int i = 0; i < PBO_COUNT; ++i)
+	{
+		pboIds[i][0] = pboIds[i][1] = 0;
+		pboFrameIndex[i] = -1;
+		pboPose[i] = cv::Mat::zeros(3, 4, CV_32FC1);
+	}
+	pboIndex = 0;
+	pboSupported = false;
+	frameIndex = 0;
+	readyFrameIndex = -1;
+	readyPose = cv::Mat::zeros(3, 4, CV_32FC1);
+	readyRect = frameRect;
+	depthBufferFrame = -1;
+
+	meshVboId = meshIboId = 0;
+	meshMode = GLM_MATERIAL | GLM_SMOOTH;
+	meshStride = 0;
+	meshRanges.clear();
+	vboSupported = vboUsed = false;
 
 	return true;
 }
@@ -397,9 +1475,24 @@ void GLRenderer::clearSharedMem()
 		rboIds[0] = rboIds[1] = 0;
 	}
 
+	// clean up PBO
+	if (pboSupported)
+	{
+		clearPBOs();
+		clearBgPBOs();
+	}
+
+	// clean up the batch atlas
+	clearAtlas();
+
+	// clean up VBO
+	if (vboSupported)
+		clearMesh();
+
 	free(rgbaBuffer);
 	free(depthBuffer);
-	free(bgImgBuffer);	
+	rgbaBuffer = 0;
+	depthBuffer = 0;
 }
 
 void GLRenderer::initLights()
@@ -421,25 +1514,61 @@ void GLRenderer::initLights()
 
 void GLRenderer::drawBgImg()
 {
-	for (int i = 0; i < renderHeight; ++i)
+	uploadBgImg();
+	drawBgQuad();
+}
+
+// upload bgImg as is into the background texture, GL swaps the channels
+// and the texture rows stay top-down, drawBgQuad() flips them.
+// With PBOs the pixels are copied into the next buffer of the ring and the
+// texture is updated from it, so the call doesn't wait for the GPU to finish
+// drawing the previous background.
+void GLRenderer::uploadBgImg()
+{
+	CV_Assert(bgImg.type() == CV_8UC3 && bgImg.cols == imageWidth && bgImg.rows == imageHeight);
+	glBindTexture(GL_TEXTURE_2D, bgImgTextureId);
+
+	if (bgPboIds[0])
 	{
-		cv::Vec3b *rptr = bgImg.ptr<cv::Vec3b>(renderHeight - i - 1);
-		for (int j = 0; j < renderWidth; ++j)
+		size_t rowSize = (size_t)imageWidth * 3;
+		bgPboIndex = (bgPboIndex + 1) % BG_PBO_COUNT;
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, bgPboIds[bgPboIndex]);
+
+		// orphan the old storage so mapping doesn't stall on a pending texture update
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, rowSize * imageHeight, 0, GL_STREAM_DRAW);
+		GLubyte *dst = (GLubyte*)glMapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
+		if (dst)
 		{
-			bgImgBuffer[i*renderWidth * 3 + 3 * j] = rptr[j][2];
-			bgImgBuffer[i*renderWidth * 3 + 3 * j + 1] = rptr[j][1];
-			bgImgBuffer[i*renderWidth * 3 + 3 * j + 2] = rptr[j][0];
+			if (bgImg.isContinuous())
+				memcpy(dst, bgImg.data, rowSize * imageHeight);
+			else
+				for (int i = 0; i < imageHeight; ++i)
+					memcpy(dst + i * rowSize, bgImg.ptr<uchar>(i), rowSize);
+			glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+			// the data pointer is an offset into the bound PBO
+			glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, imageWidth, imageHeight, GL_BGR, GL_UNSIGNED_BYTE, 0);
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+			glBindTexture(GL_TEXTURE_2D, 0);
+			return;
 		}
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
 	}
 
-	glBindTexture(GL_TEXTURE_2D, bgImgTextureId);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, renderWidth, renderHeight, 0, GL_RGB, GL_UNSIGNED_BYTE, bgImgBuffer);
+	cv::Mat img = bgImg.isContinuous() ? bgImg : bgImg.clone();
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, imageWidth, imageHeight, GL_BGR, GL_UNSIGNED_BYTE, img.data);
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
 
+// draw the background texture over the whole viewport
+void GLRenderer::drawBgQuad()
+{
+	glBindTexture(GL_TEXTURE_2D, bgImgTextureId);
 	glBegin(GL_QUADS);
-	glTexCoord2f(0.0f, 0.0f); glVertex2f(0, 0);
-	glTexCoord2f(1.0f, 0.0f); glVertex2f(renderWidth, 0);
-	glTexCoord2f(1.0f, 1.0f); glVertex2f(renderWidth, renderHeight);
-	glTexCoord2f(0.0f, 1.0f); glVertex2f(0, renderHeight);
+	glTexCoord2f(0.0f, 1.0f); glVertex2f(0, 0);
+	glTexCoord2f(1.0f, 1.0f); glVertex2f(renderWidth, 0);
+	glTexCoord2f(1.0f, 0.0f); glVertex2f(renderWidth, renderHeight);
+	glTexCoord2f(0.0f, 0.0f); glVertex2f(0, renderHeight);
 	glEnd();
 
 	glBindTexture(GL_TEXTURE_2D, 0);
@@ -823,182 +1952,326 @@ std::string GLRenderer::convertInternalFormatToString(GLenum format)
 // CALLBACKS
 //=============================================================================
 
+GLRenderer* GLRenderer::windowRenderer()
+{
+	std::map<int, GLRenderer*>::iterator it = windowRenderers.find(glutGetWindow());
+	return it != windowRenderers.end() ? it->second : 0;
+}
+
 void GLRenderer::displayCB()
+{
+	GLRenderer *renderer = windowRenderer();
+	if (renderer)
+		renderer->display();
+}
+
+void GLRenderer::reshapeCB(int width, int height)
+{
+	GLRenderer *renderer = windowRenderer();
+	if (renderer)
+		renderer->reshape(width, height);
+}
+
+void GLRenderer::keyboardCB(unsigned char key, int x, int y)
+{
+	GLRenderer *renderer = windowRenderer();
+	if (renderer)
+		renderer->keyboard(key, x, y);
+}
+
+// redraw the current pose into the window, e.g. when it is exposed or reshaped.
+// Nothing is read back and the frame counters, the ready frame and the PBOs in
+// flight are left alone, so it can run inside any glutMainLoopEvent() call.
+void GLRenderer::display()
+{
+	if (headless)
+		return;
+	makeContextCurrent();
+
+	glPushAttrib(GL_COLOR_BUFFER_BIT); // for GL_DRAW_BUFFER and the clear color
+	glDrawBuffer(GL_BACK);
+	glClearColor(0, 0, 0, 0);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	drawScene();
+	glPopAttrib(); // GL_COLOR_BUFFER_BIT
+
+	glutSwapBuffers();
+}
+
+// draw the current pose and read it back, through the PBOs if async is set
+void GLRenderer::drawFrame(bool async)
 {
 	// with FBO
-	// render directly to a texture
+	// render directly to the renderbuffers
 	if (fboUsed)
 	{
 		// set FBO as the rendering destination
 		glBindFramebuffer(GL_FRAMEBUFFER, fboId);
+	}
 
-		// clear buffer
-		glClearColor(0, 0, 0, 0);
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-		// draw background image
-		if (bgImgUsed)
-		{
-			glDisable(GL_DEPTH_TEST);
-			glDepthMask(GL_FALSE);
-			glDisable(GL_LIGHTING);	
-			glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-			
-			glMatrixMode(GL_PROJECTION);
-			glLoadIdentity();
-			gluOrtho2D(0, renderWidth, 0, renderHeight);
-			glMatrixMode(GL_MODELVIEW);
-			glLoadIdentity();
-
-			glPushMatrix();
-			drawBgImg();
-			glPopMatrix();
-
-			glEnable(GL_DEPTH_TEST);
-			glDepthMask(GL_TRUE);
-			glEnable(GL_LIGHTING);
+	// without FBO
+	// render to the backbuffer and read the backbuffer
+	else
+	{
+		glPushAttrib(GL_COLOR_BUFFER_BIT | GL_PIXEL_MODE_BIT); // for GL_DRAW_BUFFER and GL_READ_BUFFER
+		glDrawBuffer(GL_BACK);
+		glReadBuffer(GL_BACK);
+	}
 
-			// reset the draw mode
-			if (drawMode == 0)        // fill mode
-			{
-				glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-				glEnable(GL_CULL_FACE);
-			}
-			else if (drawMode == 1)  // wireframe mode
-			{
-				glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-				glDisable(GL_CULL_FACE);
-			}
-			else                    // point mode
-			{
-				glPolygonMode(GL_FRONT_AND_BACK, GL_POINT);
-				glDisable(GL_CULL_FACE);
-			}
-		}
+	// with roiUsed only the model's screen rectangle is cleared, drawn and read back,
+	// the background fills the whole image so it needs all of it
+	frameRect = cv::Rect(0, 0, renderWidth, renderHeight);
+	if (roiUsed && !(bgImgUsed && renderMode == RENDER_COLOR))
+		frameRect = modelScreenRect();
+	bool scissor = frameRect.area() < renderWidth * renderHeight;
+	if (scissor)
+	{
+		glEnable(GL_SCISSOR_TEST);
+		glScissor(frameRect.x, renderHeight - frameRect.y - frameRect.height, frameRect.width, frameRect.height);
+	}
 
-		// draw the model
-		glMatrixMode(GL_PROJECTION);
-		glLoadMatrixf(camera.getProjectionIntrinsic(renderWidth, renderHeight, nearP, farP));
+	// clear buffer
+	glClearColor(0, 0, 0, 0);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-		glMatrixMode(GL_MODELVIEW);
-		glLoadIdentity();
-		glLoadMatrixf(camera.getModelviewExtrinsic());
+	if (frameRect.area() > 0)
+		drawScene();
+	if (scissor)
+		glDisable(GL_SCISSOR_TEST);
 
-		glPushMatrix();
-#if 0
-		// draw object coordinate system
-		if (drawMode == 1)  //wireframe mode
-		{
-			glDisable(GL_DEPTH_TEST);
-			glDepthMask(GL_FALSE);
+	if (!fboUsed)
+		glPopAttrib(); // GL_COLOR_BUFFER_BIT | GL_PIXEL_MODE_BIT
 
-			drawAxis();
+	if (async)
+	{
+		readPixelsAsync();
+	}
+	else
+	{
+		readPixels();
+		readyFrameIndex = frameIndex;
+		camera.getExtrinsic().copyTo(readyPose);
+		readyRect = frameRect;
+	}
+	++frameIndex;
 
-			glEnable(GL_DEPTH_TEST);
-			glDepthMask(GL_TRUE);
-		}
-#endif
+	// unset FBO
+	if (fboUsed)
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
 
-		// draw object
-		glmDraw(model, GLM_MATERIAL | GLM_SMOOTH);
+// draw the model of the current pose without background and alpha-blend it over
+// frame in place, a BGR image of the render size, instead of drawing frame as the
+// background and reading the whole image back. Only the model's screen rectangle
+// is cleared, drawn and read. Returns that rectangle, empty if the model is
+// out of view. Needs the color render mode, bgrImg and depthMap are left as they are.
+cv::Rect GLRenderer::renderOverlay(cv::Mat &frame)
+{
+	CV_Assert(renderMode == RENDER_COLOR && frame.type() == CV_8UC3 &&
+		frame.cols == renderWidth && frame.rows == renderHeight);
 
-		glPopMatrix();
+	cv::Rect rect = modelScreenRect();
+	if (rect.area() == 0)
+		return rect;
 
-		getRGBABuffer();
-		getDepthBuffer();
+	if (!headless)
+		glutMainLoopEvent();
+	makeContextCurrent();
 
-		// unset FBO
-		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	if (fboUsed)
+	{
+		glBindFramebuffer(GL_FRAMEBUFFER, fboId);
 	}
-
-	// without FBO
-	// render to the backbuffer and copy the backbuffer to a texture
 	else
 	{
-		// clear buffer
-		glClearColor(0, 0, 0, 0);
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
 		glPushAttrib(GL_COLOR_BUFFER_BIT | GL_PIXEL_MODE_BIT); // for GL_DRAW_BUFFER and GL_READ_BUFFER
 		glDrawBuffer(GL_BACK);
 		glReadBuffer(GL_BACK);
+	}
 
-		if (bgImgUsed)
-		{
-			glDisable(GL_DEPTH_TEST);
-			glDepthMask(GL_FALSE);
-			glDisable(GL_LIGHTING);
-			glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-	
-			glMatrixMode(GL_PROJECTION);
-			glLoadIdentity();
-			gluOrtho2D(0, renderWidth, 0, renderHeight);
-			glMatrixMode(GL_MODELVIEW);
-			glLoadIdentity();
-		
-			glPushMatrix();
-			drawBgImg();
-			glPopMatrix();
+	// GL rows are bottom-up, the rectangle is top-down
+	int y = renderHeight - rect.y - rect.height;
+	glEnable(GL_SCISSOR_TEST);
+	glScissor(rect.x, y, rect.width, rect.height);
+	glClearColor(0, 0, 0, 0);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	drawScene(false);
+	glDisable(GL_SCISSOR_TEST);
 
-			glEnable(GL_DEPTH_TEST);
-			glDepthMask(GL_TRUE);
-			glEnable(GL_LIGHTING);
+	glReadBuffer(fboUsed ? GL_COLOR_ATTACHMENT0 : GL_BACK);
+	glReadPixels(rect.x, y, rect.width, rect.height, GL_RGBA, GL_UNSIGNED_BYTE, rgbaBuffer);
 
-			// reset the draw mode
-			if (drawMode == 0)        // fill mode
-			{
-				glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-				glEnable(GL_CULL_FACE);
-			}
-			else if (drawMode == 1)  // wireframe mode
-			{
-				glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-				glDisable(GL_CULL_FACE);
-			}
-			else                    // point mode
-			{
-				glPolygonMode(GL_FRONT_AND_BACK, GL_POINT);
-				glDisable(GL_CULL_FACE);
-			}
-		}
+	if (fboUsed)
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	else
+		glPopAttrib(); // GL_COLOR_BUFFER_BIT | GL_PIXEL_MODE_BIT
+	++frameIndex;
 
-		// draw the model
-		glMatrixMode(GL_PROJECTION);
-		glLoadMatrixf(camera.getProjectionIntrinsic(renderWidth, renderHeight, nearP, farP));
+	cv::Mat roi = frame(rect);
+	pixelOps::blendRgba(rgbaBuffer, rect.width, rect.height, roi);
+
+	return rect;
+}
+
+// project the corners of the model's bounding box with the projection and modelview
+// matrices drawScene() loads and the viewport, and return the render pixels they
+// cover, padded for rasterization and clipped. Going through the GL matrices keeps
+// the rectangle on the drawn model whatever the principal point is.
+// The whole image if the box reaches the near plane, empty if it is out of view.
+cv::Rect GLRenderer::modelScreenRect()
+{
+	cv::Rect image(0, 0, renderWidth, renderHeight);
+	const GLfloat *projection = camera.getProjectionIntrinsic(imageWidth, imageHeight, nearP, farP);
+	const GLfloat *modelview = camera.getModelviewExtrinsic();
+
+	float minU = FLT_MAX, minV = FLT_MAX, maxU = -FLT_MAX, maxV = -FLT_MAX;
+	for (int i = 0; i < 8; ++i)
+	{
+		float X[4] = { (i & 1) ? modelMax[0] : modelMin[0],
+			(i & 2) ? modelMax[1] : modelMin[1],
+			(i & 4) ? modelMax[2] : modelMin[2], 1.0f };
+
+		// column-major, eye = modelview * X and clip = projection * eye
+		float eye[4], clip[4];
+		for (int k = 0; k < 4; ++k)
+			eye[k] = modelview[k] * X[0] + modelview[4 + k] * X[1] + modelview[8 + k] * X[2] + modelview[12 + k] * X[3];
+		for (int k = 0; k < 4; ++k)
+			clip[k] = projection[k] * eye[0] + projection[4 + k] * eye[1] + projection[8 + k] * eye[2] + projection[12 + k] * eye[3];
+		if (clip[3] < nearP)
+			return image;
+
+		// viewport of the render size, GL rows are bottom-up and the rectangle is top-down
+		float u = (clip[0] / clip[3] + 1.0f) * 0.5f * renderWidth;
+		float v = renderHeight - (clip[1] / clip[3] + 1.0f) * 0.5f * renderHeight;
+		minU = std::min(minU, u);
+		minV = std::min(minV, v);
+		maxU = std::max(maxU, u);
+		maxV = std::max(maxV, v);
+	}
+
+	if (maxU < 0 || maxV < 0 || minU > renderWidth || minV > renderHeight)
+		return cv::Rect();
+
+	// keep the bounds in int range before rounding
+	minU = std::max(minU, -1.0f);
+	minV = std::max(minV, -1.0f);
+	maxU = std::min(maxU, (float)renderWidth + 1);
+	maxV = std::min(maxV, (float)renderHeight + 1);
+	cv::Rect rect((int)floor(minU) - 1, (int)floor(minV) - 1, 0, 0);
+	rect.width = (int)ceil(maxU) + 2 - rect.x;
+	rect.height = (int)ceil(maxV) + 2 - rect.y;
+	rect &= image;
+	return rect;
+}
 
+// draw the background and the model of the current pose
+void GLRenderer::drawScene(bool background)
+{
+	// draw background image, only the color mode shows it
+	if (background && bgImgUsed && renderMode == RENDER_COLOR)
+	{
+		glDisable(GL_DEPTH_TEST);
+		glDepthMask(GL_FALSE);
+		glDisable(GL_LIGHTING);	
+		glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+		
+		glMatrixMode(GL_PROJECTION);
+		glLoadIdentity();
+		gluOrtho2D(0, renderWidth, 0, renderHeight);
 		glMatrixMode(GL_MODELVIEW);
 		glLoadIdentity();
-		glLoadMatrixf(camera.getModelviewExtrinsic());
 
 		glPushMatrix();
-#if 0
-		// draw object coordinate system
-		if (drawMode == 1)  //wireframe mode
+		drawBgImg();
+		glPopMatrix();
+
+		glEnable(GL_DEPTH_TEST);
+		glDepthMask(GL_TRUE);
+		glEnable(GL_LIGHTING);
+
+		// reset the draw mode
+		if (drawMode == 0)        // fill mode
 		{
-			glDisable(GL_DEPTH_TEST);
-			glDepthMask(GL_FALSE);
+			glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+			glEnable(GL_CULL_FACE);
+		}
+		else if (drawMode == 1)  // wireframe mode
+		{
+			glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+			glDisable(GL_CULL_FACE);
+		}
+		else                    // point mode
+		{
+			glPolygonMode(GL_FRONT_AND_BACK, GL_POINT);
+			glDisable(GL_CULL_FACE);
+		}
+	}
 
-			drawAxis();
+	// draw the model
+	glMatrixMode(GL_PROJECTION);
+	glLoadMatrixf(camera.getProjectionIntrinsic(imageWidth, imageHeight, nearP, farP));
 
-			glEnable(GL_DEPTH_TEST);
-			glDepthMask(GL_TRUE);
+	glMatrixMode(GL_MODELVIEW);
+	glLoadIdentity();
+	glLoadMatrixf(camera.getModelviewExtrinsic());
+
+	glPushMatrix();
+#if 0
+	// draw object coordinate system
+	if (drawMode == 1)  //wireframe mode
+	{
+		glDisable(GL_DEPTH_TEST);
+		glDepthMask(GL_FALSE);
+
+		drawAxis();
+
+		glEnable(GL_DEPTH_TEST);
+		glDepthMask(GL_TRUE);
 	}
 #endif
 
-		// draw object
-		glmDraw(model, GLM_MATERIAL | GLM_SMOOTH);
-		glPopMatrix();
-		glPopAttrib(); // GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT
-	
-		getRGBABuffer();
-		getDepthBuffer();
+	// draw object
+	drawModel();
+
+	glPopMatrix();
+}
+
+// draw the model as required by the render mode, the depth and mask modes
+// only need the geometry, without lighting, materials or texturing
+void GLRenderer::drawModel()
+{
+	if (renderMode == RENDER_COLOR)
+	{
+		if (vboUsed)
+			drawMesh();
+		else
+			glmDraw(model, GLM_MATERIAL | GLM_SMOOTH);
+		return;
 	}
 
-	// draw
-	glutSwapBuffers();
+	glPushAttrib(GL_ENABLE_BIT | GL_COLOR_BUFFER_BIT | GL_CURRENT_BIT);
+	glDisable(GL_LIGHTING);
+	glDisable(GL_COLOR_MATERIAL);
+	glDisable(GL_TEXTURE_2D);
+	if (renderMode == RENDER_DEPTH)
+	{
+		glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+	}
+	else // silhouette, covered pixels are 255
+	{
+		glDisable(GL_DEPTH_TEST);
+		glColor3f(1.0f, 1.0f, 1.0f);
+	}
+
+	if (vboUsed)
+		drawMesh(true);
+	else
+		glmDraw(model, GLM_NONE);
+
+	glPopAttrib();
 }
 
-void GLRenderer::reshapeCB(int width, int height)
+void GLRenderer::reshape(int width, int height)
 {
 	screenWidth = width;
 	screenHeight = height;
@@ -1008,7 +2281,7 @@ void GLRenderer::reshapeCB(int width, int height)
 
 	// set perspective viewing frustum
 	glMatrixMode(GL_PROJECTION);
-	glLoadMatrixf(camera.getProjectionIntrinsic(renderWidth, renderHeight, nearP, farP));
+	glLoadMatrixf(camera.getProjectionIntrinsic(imageWidth, imageHeight, nearP, farP));
 
 	// switch to modelview matrix in order to set scene
 	glMatrixMode(GL_MODELVIEW);
@@ -1021,12 +2294,7 @@ void GLRenderer::timerCB(int millisec)
 	glutPostRedisplay();
 }
 
-void GLRenderer::idleCB()
-{
-	glutPostRedisplay();
-}
-
-void GLRenderer::keyboardCB(unsigned char key, int x, int y)
+void GLRenderer::keyboard(unsigned char key, int x, int y)
 {
 	switch (key)
 	{
@@ -1040,6 +2308,13 @@ void GLRenderer::keyboardCB(unsigned char key, int x, int y)
 		std::cout << "FBO mode: " << (fboUsed ? "on" : "off") << std::endl;
 		break;
 
+	case 'v': // switch between VBO and immediate mode drawing
+	case 'V':
+		if (vboSupported)
+			vboUsed = !vboUsed;
+		std::cout << "VBO mode: " << (vboUsed ? "on" : "off") << std::endl;
+		break;
+
 	case 'd': // switch rendering modes (fill -> wire -> point)
 	case 'D':
 		drawMode = ++drawMode % 3;
@@ -1066,9 +2341,4 @@ void GLRenderer::keyboardCB(unsigned char key, int x, int y)
 	default:
 		;
 	}
-}
-
-void GLRenderer::exitCB()
-{
-	clearSharedMem();
 }
\ No newline at end of file
@@ -15,71 +15,209 @@
 #include <string>
 #include <iomanip>
 #include <cstdlib>
+#include <cstring>
+#include <cfloat>
+#include <vector>
+#include <map>
 #include "glext.h"
+#ifdef USE_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
 #include "glInfo.h"                             // glInfo struct
 #include "glm.h"
 #include <opencv2/opencv.hpp>
 #include "cvCamera.h"
+#include "pixelOps.h"
 
+// Each GLRenderer owns its GL context (a GLUT window or a headless EGL context),
+// FBO, buffers and camera. Several renderers can live in one process.
+// A renderer is used by one thread at a time and its context is made current
+// by render(), call releaseContext() before handing it to another thread.
+// Windowed renderers must stay on the thread that created the first window.
+// The model is not owned, it is only read and can be shared by renderers.
 class GLRenderer
 {
 public:
+	GLRenderer();
+	~GLRenderer();
+
 	// GLUT CALLBACK functions ////////////////////////////////////////////////////
+	// dispatch to the renderer owning the current GLUT window
 	static void displayCB();
 	static void reshapeCB(int w, int h);
 	static void timerCB(int millisec);
-	static void idleCB();
 	static void keyboardCB(unsigned char key, int x, int y);
-
-	// CALLBACK function when exit() called ///////////////////////////////////////
-	static void exitCB();
+	void display();
+	void reshape(int w, int h);
+	void keyboard(unsigned char key, int x, int y);
 
 	// function declearations /////////////////////////////////////////////////////
-	static void init(int argc, char **argv, int width, int height, float nP, float fp, 
-		Camera &cam, GLMmodel *mdl);
-	static void initGL();
-	static int  initGLUT(int argc, char **argv);
-	static bool initSharedMem(int width, int height, float nP, float fp, 
+	void init(int argc, char **argv, int width, int height, float nP, float fp, 
+		Camera &cam, GLMmodel *mdl, bool hl = false);
+	void initGL();
+	int  initGLUT(int argc, char **argv);
+	bool initEGL();
+	void clearEGL();
+	void makeContextCurrent();
+	void releaseContext();
+	bool initSharedMem(int width, int height, float nP, float fp, 
 		Camera &cam, GLMmodel *mdl);
-	static void clearSharedMem();
-	static void initLights();
-	static void drawBgImg();
-	static void drawAxis();
-	static void render();
-	static bool unproject(float pixel_x, float pixel_y, float &X, float &Y, float &Z);
-	static void getRGBABuffer();
-	static void getDepthBuffer();
+	void clearSharedMem();
+	void initLights();
+	void drawBgImg();
+	void uploadBgImg();
+	void drawBgQuad();
+	void drawAxis();
+	long render();
+	long renderPipelined();
+	void drawFrame(bool async);
+	cv::Rect renderOverlay(cv::Mat &frame);
+	cv::Rect modelScreenRect();
+	void drawScene(bool background = true);
+	void drawModel();
+	int  renderBatch(const std::vector<cv::Mat> &extrinsics,
+		std::vector<cv::Mat> &bgrs, std::vector<cv::Mat> &depths);
+	bool unproject(float pixel_x, float pixel_y, float &X, float &Y, float &Z);
+	void readPixels();
+	void getRGBABuffer();
+	void getDepthBuffer();
+	void getMaskBuffer();
+	void copyRGBABuffer(const GLubyte *src, const cv::Rect &rect);
+	void copyDepthBuffer(const GLfloat *src, const cv::Rect &rect);
+	void copyMaskBuffer(const GLubyte *src, const cv::Rect &rect);
+
+	// what drawFrame() draws and reads back
+	enum RenderMode
+	{
+		RENDER_COLOR,                     // lit model over the background, BGR and depth
+		RENDER_DEPTH,                     // depth only, no color writes, background or lighting
+		RENDER_MASK                       // 8-bit silhouette only, no depth readback
+	};
+	void setRenderMode(RenderMode mode, float scale = 1.0f);
+	void setDepthFormat(pixelOps::DepthFormat format, float scale = 1000.0f);
+
+	// PBO utils, asynchronous readback
+	void initPBOs();
+	void clearPBOs();
+	void readPixelsAsync();
+	void initBgPBOs();
+	void clearBgPBOs();
+	long getLatestFrame(cv::Mat &bgr, cv::Mat &depth);
+	long getLatestFrame(cv::Mat &bgr, cv::Mat &depth, cv::Mat &pose);
+	long getLatestFrame(cv::Mat &bgr, cv::Mat &depth, cv::Mat &pose, cv::Point &offset);
+
+	// atlas FBO utils, batched multi-pose rendering
+	void initAtlas(int cols, int rows);
+	void clearAtlas();
+
+	// VBO utils, retained mesh drawing
+	void initMesh();
+	void clearMesh();
+	void drawMesh(bool geometryOnly = false);
 
 	// FBO utils
-	static bool checkFramebufferStatus();
-	static void printFramebufferInfo();
+	bool checkFramebufferStatus();
+	void printFramebufferInfo();
 	static std::string convertInternalFormatToString(GLenum format);
 	static std::string getTextureParameters(GLuint id);
 	static std::string getRenderbufferParameters(GLuint id);
 
-	// global variables
-	static GLuint fboId;                       // ID of FBO
-	static GLuint rboIds[2];                       // ID of Render buffer object
-	static int screenWidth;  // just for default win system display
-	static int screenHeight; // just for default win system display
-	static int renderWidth; // for offscreen rendering
-	static int renderHeight; // for offscreen rendering
-	static bool fboSupported;
-	static bool fboUsed;
-	static int drawMode;
-	static GLMmodel* model;
-	static float modelDimensions[3];
-	static GLubyte* rgbaBuffer;
-	static GLfloat* depthBuffer;
-	static cv::Mat bgrImg;
-	static cv::Mat depthMap;
-	static Camera camera;
-	static GLfloat nearP, farP;
-
-	static GLuint bgImgTextureId;
-	static bool bgImgUsed;
-	static cv::Mat bgImg;
-	static GLubyte* bgImgBuffer;
+	// member variables
+	GLuint fboId;                       // ID of FBO
+	GLuint rboIds[2];                       // ID of Render buffer object
+	int screenWidth;  // just for default win system display
+	int screenHeight; // just for default win system display
+	int imageWidth;  // camera image size the projection is computed for
+	int imageHeight;
+	int renderWidth; // for offscreen rendering, may be downscaled from the image size
+	int renderHeight; // for offscreen rendering
+	bool fboSupported;
+	bool fboUsed;
+	bool headless;                     // offscreen context without window, FBO only
+	int windowHandle;                  // GLUT window of the renderer, 0 if none
+	int drawMode;
+	GLMmodel* model;
+	float modelDimensions[3];
+	GLfloat modelMin[3], modelMax[3];  // bounding box of the model
+	GLubyte* rgbaBuffer;
+	GLfloat* depthBuffer;
+	long depthBufferFrame;             // frame whose window depth depthBuffer holds, -1 if none
+	cv::Rect depthBufferRect;          // rectangle of that frame in depthBuffer
+	cv::Mat bgrImg;
+	cv::Mat depthMap;
+	cv::Mat maskImg;                   // silhouette of the mask render mode
+	RenderMode renderMode;
+	pixelOps::DepthFormat depthFormat; // encoding of depthMap
+	float depthScale;                  // DEPTH_UINT16 step per model unit
+	Camera camera;
+	GLfloat nearP, farP;
+
+	GLuint bgImgTextureId;
+	bool bgImgUsed;
+	cv::Mat bgImg;
+	bool roiUsed;                      // read back only the model's screen rectangle
+	cv::Rect frameRect;                // rectangle drawn and read for the current frame
+	static const int BG_PBO_COUNT = 2;
+	GLuint bgPboIds[BG_PBO_COUNT];     // unpack PBOs the background is streamed through
+	int bgPboIndex;                    // buffer used by the last upload
+
+	// pixel buffer objects for asynchronous readback
+	// frame N is read into a PBO slot while the slot of frame N-PBO_COUNT+1 is mapped
+	static const int PBO_COUNT = 3;
+	GLuint pboIds[PBO_COUNT][2];       // color and depth PBO of each slot
+	long pboFrameIndex[PBO_COUNT];     // frame held by each slot, -1 if empty
+	cv::Mat pboPose[PBO_COUNT];        // camera extrinsic of the frame held by each slot
+	cv::Rect pboRect[PBO_COUNT];       // rectangle read into each slot
+	int pboIndex;                      // slot to be written by the next frame
+	bool pboSupported;
+	long frameIndex;                   // number of frames rendered so far
+	long readyFrameIndex;              // frame stored in bgrImg/depthMap, -1 if none
+	cv::Mat readyPose;                 // camera extrinsic of that frame
+	cv::Rect readyRect;                // rectangle of that frame that was read back
+
+	// vertex buffer objects holding the model
+	// vertices are interleaved as position, normal, texcoord and re-indexed by
+	// unique (vertex, normal, texcoord) triple, triangles are sorted by group
+	struct MeshRange
+	{
+		GLuint material;                      // index to material of the range
+		GLuint first;                         // offset of the first index
+		GLuint count;                         // number of indices
+	};
+	GLuint meshVboId;                  // ID of vertex buffer
+	GLuint meshIboId;                  // ID of index buffer
+	GLuint meshMode;                   // GLM_* flags the buffers were built with
+	GLsizei meshStride;                // bytes per interleaved vertex
+	std::vector<MeshRange> meshRanges;
+	bool vboSupported;
+	bool vboUsed;
+
+	// atlas FBO for renderBatch(), pose i is drawn into tile (i % atlasCols, i / atlasCols)
+	GLuint atlasFboId;
+	GLuint atlasRboIds[2];                // color and depth renderbuffer
+	int atlasCols, atlasRows;             // tiles of renderWidth x renderHeight
+	GLubyte* atlasRgba;                   // bottom-up readback of the atlas
+	GLfloat* atlasDepth;
+	cv::Mat atlasBgr;                     // top-down atlas images the returned views point into
+	cv::Mat atlasDepthMap;
+	cv::Mat atlasMask;
+
+#ifdef USE_EGL
+	// EGL context for headless rendering, no window system needed
+	EGLDisplay eglDisplay;
+	EGLContext eglContext;
+	EGLSurface eglSurface;             // 1x1 pbuffer, EGL_NO_SURFACE if surfaceless
+#endif
+
+	// renderer of each GLUT window for the callbacks
+	static std::map<int, GLRenderer*> windowRenderers;
+	static GLRenderer* windowRenderer();
+
+private:
+	// renderers own GL objects, they can't be copied
+	GLRenderer(const GLRenderer&);
+	GLRenderer& operator=(const GLRenderer&);
 };
 
 #endif
\ No newline at end of file
@@ -20,20 +20,152 @@ NOTE: all the indexes of vertex, normal and texture are from 1 (not 0).
 #include <string.h>
 #include <assert.h>
 #include "glm.h"
+#include "pixelOps.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 #if defined(_WIN32) || defined(_MSC_VER)
 #define strup _strup
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
 #endif
+#include <sys/types.h>
+#include <sys/stat.h>
+
+/* SSE and AVX2 kernels are built on x86 and picked at run time by
+pixelOps::simdLevel(), PIXELOPS_NO_SIMD leaves only the plain C loops */
+#if PIXELOPS_SSE2
+#include <immintrin.h>
+#endif
+
+#define GLM_SIMD_NONE 0
+#define GLM_SIMD_SSE  1
+#define GLM_SIMD_AVX2 2
+
+/* triangles per block of the parallel loops */
+#define GLM_BLOCK_SIZE 8192
 
 #define T(x) (model->triangles[(x)])
 
 
-/* _GLMnode: general purpose node */
-typedef struct _GLMnode {
-	GLuint index;
-	GLboolean averaged;
-	struct _GLMnode* next;
-} GLMnode;
+/* _GLMcell: a cell of the grid used to weld vectors */
+typedef struct _GLMcell {
+	GLint x, y, z;             /* cell coordinates */
+	GLuint head;               /* last vector kept in the cell, 0 if none */
+} GLMcell;
+
+/* welding cells are a bit more than 2 epsilon wide to absorb rounding */
+#define GLM_CELL_SIZE 2.0002
+/* cell coordinates are clamped to this magnitude, beyond it floats
+are more than epsilon apart unless they are equal */
+#define GLM_MAX_CELL 1073741824.0
+
+
+/* _GLMfilemap: a file mapped copy-on-write into memory, changes to
+* the data are private to the process and never written back */
+typedef struct _GLMfilemap {
+	char*  data;               /* contents of the file */
+	size_t size;               /* size of the file in bytes */
+#if defined(_WIN32) || defined(_MSC_VER)
+	HANDLE file;
+	HANDLE mapping;
+#endif
+} GLMfilemap;
+
+
+/* _GLMevent: a group or material statement seen while parsing a chunk */
+typedef struct _GLMevent {
+	char type;                 /* 'g'roup, 'u'semtl or 'm'tllib */
+	GLuint triangle;           /* index of the next triangle in the chunk */
+	const char* name;          /* name in the file contents */
+	const char* nameend;
+	GLMgroup* group;           /* group after the statement (set by merge) */
+} GLMevent;
+
+
+/* _GLMchunk: a range of lines of an OBJ file parsed on its own */
+typedef struct _GLMchunk {
+	const char* begin;         /* first line of the chunk */
+	const char* end;           /* end of the last line of the chunk */
+
+	GLuint numvertices, maxvertices;
+	GLfloat* vertices;         /* 0-based, unlike GLMmodel */
+	GLuint numnormals, maxnormals;
+	GLfloat* normals;
+	GLuint numtexcoords, maxtexcoords;
+	GLfloat* texcoords;
+	GLuint numtriangles, maxtriangles;
+	GLMtriangle* triangles;    /* indices absolute or chunk relative */
+	GLuint numevents, maxevents;
+	GLMevent* events;
+
+	GLuint basevertices;       /* elements in the preceding chunks */
+	GLuint basenormals;
+	GLuint basetexcoords;
+	GLuint basetriangles;
+	GLMgroup* group;           /* group at the start of the chunk */
+} GLMchunk;
+
+/* files are split into chunks of at least this many bytes */
+#define GLM_MIN_CHUNK_SIZE (1 << 20)
+/* offset of chunk relative face indices, see glmParseChunk */
+#define GLM_RELATIVE 0x40000000
+
+/* binary model files (see glmWriteBIN), all sections start at 16 byte
+* aligned offsets and vertex arrays are stored 1-based like in GLMmodel */
+#define GLM_BIN_MAGIC   "GLMB"
+#define GLM_BIN_VERSION 1
+#define GLM_BIN_NONE    0xffffffff  /* offset of a missing string */
+#define GLM_BIN_ALIGN(x) (((x) + 15) & ~(GLuint)15)
+
+/* _GLMbinheader: header at the start of a binary model file */
+typedef struct _GLMbinheader {
+	char    magic[4];          /* GLM_BIN_MAGIC */
+	GLuint  version;           /* GLM_BIN_VERSION */
+	GLuint  size;              /* size of the file in bytes */
+	GLuint  numvertices;
+	GLuint  numnormals;
+	GLuint  numtexcoords;
+	GLuint  numfacetnorms;
+	GLuint  numtriangles;
+	GLuint  nummaterials;
+	GLuint  numgroups;
+	GLuint  numgrouptriangles; /* sum of the triangles of all groups */
+	GLuint  vertices;          /* section offsets, 0 if missing */
+	GLuint  normals;
+	GLuint  texcoords;
+	GLuint  facetnorms;
+	GLuint  triangles;         /* GLMtriangle records */
+	GLuint  grouptriangles;    /* triangle lists of all groups */
+	GLuint  groups;            /* GLMbingroup records */
+	GLuint  materials;         /* GLMbinmaterial records */
+	GLuint  strings;           /* NUL terminated names */
+	GLuint  stringsize;
+	GLuint  mtllibname;        /* string offset or GLM_BIN_NONE */
+	GLfloat position[3];
+} GLMbinheader;
+
+/* _GLMbingroup: a group in a binary model file */
+typedef struct _GLMbingroup {
+	GLuint name;               /* string offset */
+	GLuint numtriangles;
+	GLuint first;              /* first triangle in grouptriangles */
+	GLuint material;
+} GLMbingroup;
+
+/* _GLMbinmaterial: a material in a binary model file */
+typedef struct _GLMbinmaterial {
+	GLuint  name;              /* string offset */
+	GLfloat diffuse[4];
+	GLfloat ambient[4];
+	GLfloat specular[4];
+	GLfloat emmissive[4];
+	GLfloat shininess;
+} GLMbinmaterial;
 
 
 /* glmMax: returns the maximum of two floats */
@@ -119,8 +251,432 @@ glmEqual(GLfloat* u, GLfloat* v, GLfloat epsilon)
 	return GL_FALSE;
 }
 
+/* glmSimdLevel: returns the widest of the kernels below that
+* pixelOps::simdLevel() allows on this cpu.
+*/
+static int
+glmSimdLevel(GLvoid)
+{
+	int level = pixelOps::simdLevel();
+
+	if (level >= pixelOps::SIMD_AVX2)
+		return GLM_SIMD_AVX2;
+	if (level >= pixelOps::SIMD_SSE2)
+		return GLM_SIMD_SSE;
+	return GLM_SIMD_NONE;
+}
+
+/* glmBoundsC: grows a bounding box by count vectors, plain C.  The
+* comparisons are the ones glmDimensions always used, so NaNs never
+* get into the box.
+*
+* vectors - array of GLfloat[3]'s
+* count   - number of vectors
+* min     - minimum of each component, updated on return
+* max     - maximum of each component, updated on return
+*/
+static GLvoid
+glmBoundsC(const GLfloat* vectors, GLuint count, GLfloat* min, GLfloat* max)
+{
+	GLuint i, c;
+
+	for (i = 0; i < count; i++, vectors += 3) {
+		for (c = 0; c < 3; c++) {
+			if (max[c] < vectors[c])
+				max[c] = vectors[c];
+			if (min[c] > vectors[c])
+				min[c] = vectors[c];
+		}
+	}
+}
+
+/* glmTransformC: translates count vectors by -center (unless center
+* is NULL) and then scales them, plain C.
+*
+* vectors - array of GLfloat[3]'s
+* count   - number of vectors
+* center  - GLfloat[3] subtracted from each vector, or NULL
+* scale   - scalefactor
+*/
+static GLvoid
+glmTransformC(GLfloat* vectors, GLuint count, const GLfloat* center, GLfloat scale)
+{
+	GLuint i;
+
+	for (i = 0; i < count; i++, vectors += 3) {
+		if (center) {
+			vectors[0] -= center[0];
+			vectors[1] -= center[1];
+			vectors[2] -= center[2];
+		}
+		vectors[0] *= scale;
+		vectors[1] *= scale;
+		vectors[2] *= scale;
+	}
+}
+
+/* glmFacetNormalsC: computes the facet normals of count triangles,
+* plain C.  The normal of triangle i is stored at facetnorms[3 * (i + 1)]
+* and the triangle is pointed at it.
+*
+* vertices   - 1-based array of GLfloat[3]'s
+* triangles  - array of triangles
+* facetnorms - 1-based array of GLfloat[3]'s
+* first      - index of the first triangle
+* count      - number of triangles
+*/
+static GLvoid
+glmFacetNormalsC(const GLfloat* vertices, GLMtriangle* triangles,
+	GLfloat* facetnorms, GLuint first, GLuint count)
+{
+	const GLfloat* v0;
+	const GLfloat* v1;
+	const GLfloat* v2;
+	GLfloat u[3];
+	GLfloat v[3];
+	GLuint i;
+
+	for (i = first; i < first + count; i++) {
+		triangles[i].findex = i + 1;
+
+		v0 = &vertices[3 * triangles[i].vindices[0]];
+		v1 = &vertices[3 * triangles[i].vindices[1]];
+		v2 = &vertices[3 * triangles[i].vindices[2]];
+		u[0] = v1[0] - v0[0];
+		u[1] = v1[1] - v0[1];
+		u[2] = v1[2] - v0[2];
+		v[0] = v2[0] - v0[0];
+		v[1] = v2[1] - v0[1];
+		v[2] = v2[2] - v0[2];
+
+		glmCross(u, v, &facetnorms[3 * (i + 1)]);
+		glmNormalize(&facetnorms[3 * (i + 1)]);
+	}
+}
+
+#if PIXELOPS_SSE2
+/* The vector kernels work on packed GLfloat[3]'s: 4 vectors fill 3 SSE
+* registers and 8 vectors 3 AVX registers, lane j of register r then
+* holds component (r * lanes + j) % 3.  They compute exactly what the
+* plain C loops compute (no fused multiply-add), so the results don't
+* depend on the cpu.
+*/
+
+/* glmBoundsSSE: glmBoundsC with SSE */
+static GLvoid
+glmBoundsSSE(const GLfloat* vectors, GLuint count, GLfloat* min, GLfloat* max)
+{
+	GLfloat lo[12], hi[12];
+	__m128 lo0, lo1, lo2, hi0, hi1, hi2, r0, r1, r2;
+	GLuint i;
+
+	for (i = 0; i < 12; i++) {
+		lo[i] = min[i % 3];
+		hi[i] = max[i % 3];
+	}
+	lo0 = _mm_loadu_ps(lo); lo1 = _mm_loadu_ps(lo + 4); lo2 = _mm_loadu_ps(lo + 8);
+	hi0 = _mm_loadu_ps(hi); hi1 = _mm_loadu_ps(hi + 4); hi2 = _mm_loadu_ps(hi + 8);
+
+	/* minps/maxps return the second operand when either is NaN, which
+	keeps NaNs out like the plain comparisons do */
+	for (i = 0; i + 4 <= count; i += 4, vectors += 12) {
+		r0 = _mm_loadu_ps(vectors);
+		r1 = _mm_loadu_ps(vectors + 4);
+		r2 = _mm_loadu_ps(vectors + 8);
+		lo0 = _mm_min_ps(r0, lo0); hi0 = _mm_max_ps(r0, hi0);
+		lo1 = _mm_min_ps(r1, lo1); hi1 = _mm_max_ps(r1, hi1);
+		lo2 = _mm_min_ps(r2, lo2); hi2 = _mm_max_ps(r2, hi2);
+	}
+
+	_mm_storeu_ps(lo, lo0); _mm_storeu_ps(lo + 4, lo1); _mm_storeu_ps(lo + 8, lo2);
+	_mm_storeu_ps(hi, hi0); _mm_storeu_ps(hi + 4, hi1); _mm_storeu_ps(hi + 8, hi2);
+	glmBoundsC(lo, 4, min, max);
+	glmBoundsC(hi, 4, min, max);
+	glmBoundsC(vectors, count - i, min, max);
+}
+
+/* glmTransformSSE: glmTransformC with SSE */
+static GLvoid
+glmTransformSSE(GLfloat* vectors, GLuint count, const GLfloat* center, GLfloat scale)
+{
+	GLfloat c[12];
+	__m128 c0, c1, c2, s, r0, r1, r2;
+	GLuint i;
+
+	for (i = 0; i < 12; i++)
+		c[i] = center ? center[i % 3] : 0.0f;
+	c0 = _mm_loadu_ps(c); c1 = _mm_loadu_ps(c + 4); c2 = _mm_loadu_ps(c + 8);
+	s = _mm_set1_ps(scale);
+
+	for (i = 0; i + 4 <= count; i += 4, vectors += 12) {
+		r0 = _mm_loadu_ps(vectors);
+		r1 = _mm_loadu_ps(vectors + 4);
+		r2 = _mm_loadu_ps(vectors + 8);
+		if (center) {
+			r0 = _mm_sub_ps(r0, c0);
+			r1 = _mm_sub_ps(r1, c1);
+			r2 = _mm_sub_ps(r2, c2);
+		}
+		_mm_storeu_ps(vectors, _mm_mul_ps(r0, s));
+		_mm_storeu_ps(vectors + 4, _mm_mul_ps(r1, s));
+		_mm_storeu_ps(vectors + 8, _mm_mul_ps(r2, s));
+	}
+	glmTransformC(vectors, count - i, center, scale);
+}
+
+/* glmFacetNormalsSSE: glmFacetNormalsC with SSE, 4 triangles at a time */
+static GLvoid
+glmFacetNormalsSSE(const GLfloat* vertices, GLMtriangle* triangles,
+	GLfloat* facetnorms, GLuint first, GLuint count)
+{
+	GLfloat n[3][4];
+	const GLfloat* p[3][4];
+	__m128 x[3], y[3], z[3];
+	__m128 ux, uy, uz, vx, vy, vz, nx, ny, nz, l;
+	GLuint i, j, k;
+
+	for (i = first; i + 4 <= first + count; i += 4) {
+		for (j = 0; j < 4; j++)
+			for (k = 0; k < 3; k++)
+				p[k][j] = &vertices[3 * triangles[i + j].vindices[k]];
+		for (k = 0; k < 3; k++) {
+			x[k] = _mm_setr_ps(p[k][0][0], p[k][1][0], p[k][2][0], p[k][3][0]);
+			y[k] = _mm_setr_ps(p[k][0][1], p[k][1][1], p[k][2][1], p[k][3][1]);
+			z[k] = _mm_setr_ps(p[k][0][2], p[k][1][2], p[k][2][2], p[k][3][2]);
+		}
+
+		ux = _mm_sub_ps(x[1], x[0]); uy = _mm_sub_ps(y[1], y[0]); uz = _mm_sub_ps(z[1], z[0]);
+		vx = _mm_sub_ps(x[2], x[0]); vy = _mm_sub_ps(y[2], y[0]); vz = _mm_sub_ps(z[2], z[0]);
+		nx = _mm_sub_ps(_mm_mul_ps(uy, vz), _mm_mul_ps(uz, vy));
+		ny = _mm_sub_ps(_mm_mul_ps(uz, vx), _mm_mul_ps(ux, vz));
+		nz = _mm_sub_ps(_mm_mul_ps(ux, vy), _mm_mul_ps(uy, vx));
+		l = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, nx), _mm_mul_ps(ny, ny)),
+			_mm_mul_ps(nz, nz)));
+		_mm_storeu_ps(n[0], _mm_div_ps(nx, l));
+		_mm_storeu_ps(n[1], _mm_div_ps(ny, l));
+		_mm_storeu_ps(n[2], _mm_div_ps(nz, l));
+
+		for (j = 0; j < 4; j++) {
+			triangles[i + j].findex = i + j + 1;
+			facetnorms[3 * (i + j + 1) + 0] = n[0][j];
+			facetnorms[3 * (i + j + 1) + 1] = n[1][j];
+			facetnorms[3 * (i + j + 1) + 2] = n[2][j];
+		}
+	}
+	glmFacetNormalsC(vertices, triangles, facetnorms, i, first + count - i);
+}
+#endif
+
+#if PIXELOPS_TARGETS
+/* glmBoundsAVX2: glmBoundsC with AVX2 */
+PIXELOPS_TARGET("avx2") static GLvoid
+glmBoundsAVX2(const GLfloat* vectors, GLuint count, GLfloat* min, GLfloat* max)
+{
+	GLfloat lo[24], hi[24];
+	__m256 lo0, lo1, lo2, hi0, hi1, hi2, r0, r1, r2;
+	GLuint i;
+
+	for (i = 0; i < 24; i++) {
+		lo[i] = min[i % 3];
+		hi[i] = max[i % 3];
+	}
+	lo0 = _mm256_loadu_ps(lo); lo1 = _mm256_loadu_ps(lo + 8); lo2 = _mm256_loadu_ps(lo + 16);
+	hi0 = _mm256_loadu_ps(hi); hi1 = _mm256_loadu_ps(hi + 8); hi2 = _mm256_loadu_ps(hi + 16);
+
+	for (i = 0; i + 8 <= count; i += 8, vectors += 24) {
+		r0 = _mm256_loadu_ps(vectors);
+		r1 = _mm256_loadu_ps(vectors + 8);
+		r2 = _mm256_loadu_ps(vectors + 16);
+		lo0 = _mm256_min_ps(r0, lo0); hi0 = _mm256_max_ps(r0, hi0);
+		lo1 = _mm256_min_ps(r1, lo1); hi1 = _mm256_max_ps(r1, hi1);
+		lo2 = _mm256_min_ps(r2, lo2); hi2 = _mm256_max_ps(r2, hi2);
+	}
+
+	_mm256_storeu_ps(lo, lo0); _mm256_storeu_ps(lo + 8, lo1); _mm256_storeu_ps(lo + 16, lo2);
+	_mm256_storeu_ps(hi, hi0); _mm256_storeu_ps(hi + 8, hi1); _mm256_storeu_ps(hi + 16, hi2);
+	glmBoundsC(lo, 8, min, max);
+	glmBoundsC(hi, 8, min, max);
+	glmBoundsC(vectors, count - i, min, max);
+}
+
+/* glmTransformAVX2: glmTransformC with AVX2 */
+PIXELOPS_TARGET("avx2") static GLvoid
+glmTransformAVX2(GLfloat* vectors, GLuint count, const GLfloat* center, GLfloat scale)
+{
+	GLfloat c[24];
+	__m256 c0, c1, c2, s, r0, r1, r2;
+	GLuint i;
+
+	for (i = 0; i < 24; i++)
+		c[i] = center ? center[i % 3] : 0.0f;
+	c0 = _mm256_loadu_ps(c); c1 = _mm256_loadu_ps(c + 8); c2 = _mm256_loadu_ps(c + 16);
+	s = _mm256_set1_ps(scale);
+
+	for (i = 0; i + 8 <= count; i += 8, vectors += 24) {
+		r0 = _mm256_loadu_ps(vectors);
+		r1 = _mm256_loadu_ps(vectors + 8);
+		r2 = _mm256_loadu_ps(vectors + 16);
+		if (center) {
+			r0 = _mm256_sub_ps(r0, c0);
+			r1 = _mm256_sub_ps(r1, c1);
+			r2 = _mm256_sub_ps(r2, c2);
+		}
+		_mm256_storeu_ps(vectors, _mm256_mul_ps(r0, s));
+		_mm256_storeu_ps(vectors + 8, _mm256_mul_ps(r1, s));
+		_mm256_storeu_ps(vectors + 16, _mm256_mul_ps(r2, s));
+	}
+	glmTransformC(vectors, count - i, center, scale);
+}
+
+/* glmFacetNormalsAVX2: glmFacetNormalsC with AVX2, 8 triangles at a
+* time, gathering the vertex indices and the vertices
+*/
+PIXELOPS_TARGET("avx2") static GLvoid
+glmFacetNormalsAVX2(const GLfloat* vertices, GLMtriangle* triangles,
+	GLfloat* facetnorms, GLuint first, GLuint count)
+{
+	GLfloat n[3][8];
+	__m256i stride, index;
+	__m256 x[3], y[3], z[3];
+	__m256 ux, uy, uz, vx, vy, vz, nx, ny, nz, l;
+	const int* t;
+	GLuint i, j, k;
+
+	/* GLMtriangle is 10 GLuints, vindices first */
+	stride = _mm256_setr_epi32(0, 10, 20, 30, 40, 50, 60, 70);
+	for (i = first; i + 8 <= first + count; i += 8) {
+		t = (const int*)&triangles[i];
+		for (k = 0; k < 3; k++) {
+			index = _mm256_i32gather_epi32(t + k, stride, 4);
+			index = _mm256_add_epi32(index, _mm256_add_epi32(index, index));
+			x[k] = _mm256_i32gather_ps(vertices + 0, index, 4);
+			y[k] = _mm256_i32gather_ps(vertices + 1, index, 4);
+			z[k] = _mm256_i32gather_ps(vertices + 2, index, 4);
+		}
+
+		ux = _mm256_sub_ps(x[1], x[0]); uy = _mm256_sub_ps(y[1], y[0]); uz = _mm256_sub_ps(z[1], z[0]);
+		vx = _mm256_sub_ps(x[2], x[0]); vy = _mm256_sub_ps(y[2], y[0]); vz = _mm256_sub_ps(z[2], z[0]);
+		nx = _mm256_sub_ps(_mm256_mul_ps(uy, vz), _mm256_mul_ps(uz, vy));
+		ny = _mm256_sub_ps(_mm256_mul_ps(uz, vx), _mm256_mul_ps(ux, vz));
+		nz = _mm256_sub_ps(_mm256_mul_ps(ux, vy), _mm256_mul_ps(uy, vx));
+		l = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx, nx),
+			_mm256_mul_ps(ny, ny)), _mm256_mul_ps(nz, nz)));
+		_mm256_storeu_ps(n[0], _mm256_div_ps(nx, l));
+		_mm256_storeu_ps(n[1], _mm256_div_ps(ny, l));
+		_mm256_storeu_ps(n[2], _mm256_div_ps(nz, l));
+
+		for (j = 0; j < 8; j++) {
+			triangles[i + j].findex = i + j + 1;
+			facetnorms[3 * (i + j + 1) + 0] = n[0][j];
+			facetnorms[3 * (i + j + 1) + 1] = n[1][j];
+			facetnorms[3 * (i + j + 1) + 2] = n[2][j];
+		}
+	}
+	glmFacetNormalsC(vertices, triangles, facetnorms, i, first + count - i);
+}
+#endif
+
+/* glmBounds: glmBoundsC with the widest kernel the cpu supports */
+static GLvoid
+glmBounds(const GLfloat* vectors, GLuint count, GLfloat* min, GLfloat* max)
+{
+	switch (glmSimdLevel()) {
+#if PIXELOPS_TARGETS
+	case GLM_SIMD_AVX2: glmBoundsAVX2(vectors, count, min, max); break;
+#endif
+#if PIXELOPS_SSE2
+	case GLM_SIMD_SSE: glmBoundsSSE(vectors, count, min, max); break;
+#endif
+	default: glmBoundsC(vectors, count, min, max); break;
+	}
+}
+
+/* glmTransform: glmTransformC with the widest kernel the cpu supports */
+static GLvoid
+glmTransform(GLfloat* vectors, GLuint count, const GLfloat* center, GLfloat scale)
+{
+	switch (glmSimdLevel()) {
+#if PIXELOPS_TARGETS
+	case GLM_SIMD_AVX2: glmTransformAVX2(vectors, count, center, scale); break;
+#endif
+#if PIXELOPS_SSE2
+	case GLM_SIMD_SSE: glmTransformSSE(vectors, count, center, scale); break;
+#endif
+	default: glmTransformC(vectors, count, center, scale); break;
+	}
+}
+
+/* glmFacetNormalsBlock: glmFacetNormalsC with the widest kernel the
+* cpu supports
+*/
+static GLvoid
+glmFacetNormalsBlock(const GLfloat* vertices, GLMtriangle* triangles,
+	GLfloat* facetnorms, GLuint first, GLuint count)
+{
+	switch (glmSimdLevel()) {
+#if PIXELOPS_TARGETS
+	case GLM_SIMD_AVX2: glmFacetNormalsAVX2(vertices, triangles, facetnorms, first, count); break;
+#endif
+#if PIXELOPS_SSE2
+	case GLM_SIMD_SSE: glmFacetNormalsSSE(vertices, triangles, facetnorms, first, count); break;
+#endif
+	default: glmFacetNormalsC(vertices, triangles, facetnorms, first, count); break;
+	}
+}
+
+/* glmCell: returns the cell of the welding grid a coordinate is in
+* and, in side, the adjacent cell that is nearer to the coordinate.
+* Cells are over 2 epsilon wide, so vectors that glmEqual finds equal
+* are in the same cell or in the nearer adjacent one on each axis.
+*
+* f     - coordinate
+* scale - 1 / cell size
+* side  - -1 or 1 on return
+*/
+static GLint
+glmCell(GLfloat f, GLdouble scale, GLint* side)
+{
+	GLdouble c = f * scale;
+	GLdouble cell = floor(c);
+
+	*side = c - cell < 0.5 ? -1 : 1;
+
+	/* clamping keeps adjacent cells adjacent, NaNs go to the lowest
+	cell but never equal anything anyway */
+	if (!(cell > -GLM_MAX_CELL))
+		cell = -GLM_MAX_CELL;
+	if (cell > GLM_MAX_CELL)
+		cell = GLM_MAX_CELL;
+	return (GLint)cell;
+}
+
+/* glmFindCell: returns the slot of a cell in the hash table of the
+* welding grid, an unused slot (head 0) if the cell has no vectors yet.
+*
+* table - hash table, size is a power of 2 and never full
+* mask  - size of the table - 1
+* x,y,z - cell coordinates
+*/
+static GLMcell*
+glmFindCell(GLMcell* table, GLuint mask, GLint x, GLint y, GLint z)
+{
+	GLuint h;
+	GLMcell* cell;
+
+	h = (GLuint)x * 73856093u ^ (GLuint)y * 19349663u ^ (GLuint)z * 83492791u;
+	h ^= h >> 16;
+	for (h &= mask;; h = (h + 1) & mask) {
+		cell = &table[h];
+		if (!cell->head || (cell->x == x && cell->y == y && cell->z == z))
+			return cell;
+	}
+}
+
 /* glmWeldVectors: eliminate (weld) vectors that are within an
-* epsilon of each other.
+* epsilon of each other.  Each vector is welded to the first kept
+* vector it equals (see glmEqual), or kept itself if there is none.
+* Kept vectors are binned in a hashed grid of 2 epsilon sized cells so
+* only the 8 cells around a vector need to be searched.
 *
 * vectors     - array of GLfloat[3]'s to be welded
 * numvectors - number of GLfloat[3]'s in vectors
@@ -132,33 +688,94 @@ glmWeldVectors(GLfloat* vectors, GLuint* numvectors, GLfloat epsilon)
 {
 	GLfloat* copies;
 	GLuint copied;
-	GLuint i, j;
+	GLint* cells;              /* cell of each vector */
+	GLbyte* sides;             /* nearer adjacent cells as bits */
+	GLMcell* table;            /* cells holding kept vectors */
+	GLMcell* cell;
+	GLuint* next;              /* next kept vector in the same cell */
+	GLuint mask;
+	GLdouble scale;
+	GLuint i, j, k;
+	int n, count;              /* signed for OpenMP */
+	GLint side[3];
+	int c;
 
 	copies = (GLfloat*)malloc(sizeof(GLfloat) * 3 * (*numvectors + 1));
 	memcpy(copies, vectors, (sizeof(GLfloat) * 3 * (*numvectors + 1)));
 
-	copied = 1;
+	/* nothing is within a non-positive epsilon of anything */
+	if (!(epsilon > 0)) {
+		for (i = 1; i <= *numvectors; i++)
+			vectors[3 * i + 0] = (GLfloat)i;
+		return copies;
+	}
+
+	/* the cells can be found independently */
+	scale = 1.0 / (epsilon * GLM_CELL_SIZE);
+	cells = (GLint*)malloc(sizeof(GLint) * 3 * (*numvectors + 1));
+	sides = (GLbyte*)malloc(*numvectors + 1);
+	count = (int)*numvectors;
+#pragma omp parallel for private(side)
+	for (n = 1; n <= count; n++) {
+		cells[3 * n + 0] = glmCell(vectors[3 * n + 0], scale, &side[0]);
+		cells[3 * n + 1] = glmCell(vectors[3 * n + 1], scale, &side[1]);
+		cells[3 * n + 2] = glmCell(vectors[3 * n + 2], scale, &side[2]);
+		sides[n] = (GLbyte)((side[0] > 0) | (side[1] > 0) << 1 | (side[2] > 0) << 2);
+	}
+
+	/* keep the table at most half full */
+	for (mask = 15; mask < 2 * *numvectors; mask = mask * 2 + 1)
+		;
+	table = (GLMcell*)calloc(mask + 1, sizeof(GLMcell));
+	next = (GLuint*)malloc(sizeof(GLuint) * (*numvectors + 1));
+
+	/* welding depends on the vectors kept so far, so this is serial */
+	copied = 0;
 	for (i = 1; i <= *numvectors; i++) {
-		for (j = 1; j <= copied; j++) {
-			if (glmEqual(&vectors[3 * i], &copies[3 * j], epsilon)) {
-				goto duplicate;
+		/* search the cell and the nearer adjacent cells, bit 0-2 of c
+		selects whether to step to the adjacent cell along x, y, z */
+		side[0] = sides[i] & 1 ? 1 : -1;
+		side[1] = sides[i] & 2 ? 1 : -1;
+		side[2] = sides[i] & 4 ? 1 : -1;
+		j = 0;
+		for (c = 0; c < 8; c++) {
+			cell = glmFindCell(table, mask,
+				cells[3 * i + 0] + (c & 1 ? side[0] : 0),
+				cells[3 * i + 1] + (c & 2 ? side[1] : 0),
+				cells[3 * i + 2] + (c & 4 ? side[2] : 0));
+			for (k = cell->head; k; k = next[k]) {
+				if ((!j || k < j) && glmEqual(&vectors[3 * i], &copies[3 * k], epsilon))
+					j = k;
 			}
 		}
 
-		/* must not be any duplicates -- add to the copies array */
-		copies[3 * copied + 0] = vectors[3 * i + 0];
-		copies[3 * copied + 1] = vectors[3 * i + 1];
-		copies[3 * copied + 2] = vectors[3 * i + 2];
-		j = copied;             /* pass this along for below */
-		copied++;
+		if (!j) {
+			/* must not be any duplicates -- add to the copies array */
+			copied++;
+			copies[3 * copied + 0] = vectors[3 * i + 0];
+			copies[3 * copied + 1] = vectors[3 * i + 1];
+			copies[3 * copied + 2] = vectors[3 * i + 2];
+			cell = glmFindCell(table, mask, cells[3 * i + 0],
+				cells[3 * i + 1], cells[3 * i + 2]);
+			cell->x = cells[3 * i + 0];
+			cell->y = cells[3 * i + 1];
+			cell->z = cells[3 * i + 2];
+			next[copied] = cell->head;
+			cell->head = copied;
+			j = copied;
+		}
 
-	duplicate:
 		/* set the first component of this vector to point at the correct
 		index into the new copies array */
 		vectors[3 * i + 0] = (GLfloat)j;
 	}
 
-	*numvectors = copied - 1;
+	free(cells);
+	free(sides);
+	free(table);
+	free(next);
+
+	*numvectors = copied;
 	return copies;
 }
 
@@ -436,343 +1053,817 @@ glmWriteMTL(GLMmodel* model, char* modelpath, char* mtllibname)
 	}
 }
 
-
-/* glmFirstPass: first pass at a Wavefront OBJ file that gets all the
-* statistics of the model (such as #vertices, #normals, etc)
+
+/* glmMapFile: map a whole file read-only into memory.  Returns
+* GL_FALSE if the file can't be opened.
+*
+* filemap  - structure receiving the mapping
+* filename - name of the file to map
+*/
+static GLboolean
+glmMapFile(GLMfilemap* filemap, const char* filename)
+{
+	filemap->data = NULL;
+	filemap->size = 0;
+
+#if defined(_WIN32) || defined(_MSC_VER)
+	LARGE_INTEGER size;
+
+	filemap->mapping = NULL;
+	filemap->file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL,
+		OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (filemap->file == INVALID_HANDLE_VALUE)
+		return GL_FALSE;
+	if (!GetFileSizeEx(filemap->file, &size)) {
+		CloseHandle(filemap->file);
+		return GL_FALSE;
+	}
+	filemap->size = (size_t)size.QuadPart;
+	if (filemap->size == 0)     /* empty files can't be mapped */
+		return GL_TRUE;
+	filemap->mapping = CreateFileMappingA(filemap->file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+	if (filemap->mapping)
+		filemap->data = (char*)MapViewOfFile(filemap->mapping, FILE_MAP_COPY, 0, 0, 0);
+	if (!filemap->data) {
+		if (filemap->mapping)
+			CloseHandle(filemap->mapping);
+		CloseHandle(filemap->file);
+		return GL_FALSE;
+	}
+#else
+	struct stat st;
+	int fd;
+
+	fd = open(filename, O_RDONLY);
+	if (fd < 0)
+		return GL_FALSE;
+	if (fstat(fd, &st) < 0) {
+		close(fd);
+		return GL_FALSE;
+	}
+	filemap->size = (size_t)st.st_size;
+	if (filemap->size > 0) {
+		filemap->data = (char*)mmap(NULL, filemap->size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+		if (filemap->data == MAP_FAILED) {
+			filemap->data = NULL;
+			close(fd);
+			return GL_FALSE;
+		}
+		madvise(filemap->data, filemap->size, MADV_SEQUENTIAL);
+	}
+	close(fd);                  /* the mapping stays valid */
+#endif
+
+	return GL_TRUE;
+}
+
+/* glmUnmapFile: release a mapping made by glmMapFile */
+static GLvoid
+glmUnmapFile(GLMfilemap* filemap)
+{
+#if defined(_WIN32) || defined(_MSC_VER)
+	if (filemap->data)
+		UnmapViewOfFile(filemap->data);
+	if (filemap->mapping)
+		CloseHandle(filemap->mapping);
+	CloseHandle(filemap->file);
+#else
+	if (filemap->data)
+		munmap(filemap->data, filemap->size);
+#endif
+	filemap->data = NULL;
+	filemap->size = 0;
+}
+
+/* glmFree: free an array of the model unless it points into the file
+* the model was mapped from by glmReadBIN.
+*
+* model - initialized GLMmodel structure
+* ptr   - array to free (may be NULL)
+*/
+static GLvoid
+glmFree(GLMmodel* model, GLvoid* ptr)
+{
+	GLMfilemap* filemap = (GLMfilemap*)model->filemap;
+
+	if (filemap && (char*)ptr >= filemap->data &&
+		(char*)ptr < filemap->data + filemap->size)
+		return;
+	free(ptr);
+}
+
+/* glmLittleEndian: binary model files are little-endian */
+static GLboolean
+glmLittleEndian(GLvoid)
+{
+	GLuint one = 1;
+
+	return *(unsigned char*)&one == 1;
+}
+
+/* glmBinName: return the name of the binary model next to an OBJ
+* file, the path with its extension replaced by .bin
+*
+* path - filesystem path
+*
+* NOTE: the return value should be free'd.
+*/
+static char*
+glmBinName(char* path)
+{
+	char* name;
+	char* ext;
+	char* s;
+
+	name = (char*)malloc(strlen(path) + 5);
+	strcpy(name, path);
+
+	/* find the extension of the last path component */
+	ext = NULL;
+	for (s = name; *s; s++) {
+		if (*s == '/' || *s == '\\')
+			ext = NULL;
+		else if (*s == '.')
+			ext = s;
+	}
+	strcpy(ext ? ext : s, ".bin");
+
+	return name;
+}
+
+/* glmNewer: returns GL_TRUE if the file a exists and was modified
+* after the file b
+*/
+static GLboolean
+glmNewer(char* a, char* b)
+{
+	struct stat sa, sb;
+
+	if (stat(a, &sa) != 0 || stat(b, &sb) != 0)
+		return GL_FALSE;
+	return sa.st_mtime > sb.st_mtime;
+}
+
+/* glmCheckSection: returns GL_TRUE if a section of a binary model
+* file of the given size holds count elements.  Missing sections
+* (offset 0) are only fine when the section isn't required.
+*/
+static GLboolean
+glmCheckSection(size_t size, GLuint offset, GLuint count, size_t elemsize,
+	GLboolean required)
+{
+	if (!offset)
+		return !required;
+	if (offset % 16 || offset > size)
+		return GL_FALSE;
+	return count <= (size - offset) / elemsize;
+}
+
+/* glmCheckBIN: returns GL_TRUE if the mapped file looks like a binary
+* model that this build can read.  The sections and names are checked
+* to be inside the file and every index to be inside its array, so a
+* damaged or stale file is rejected instead of read out of bounds.
+* This touches every triangle once.
+*/
+static GLboolean
+glmCheckBIN(GLMfilemap* filemap)
+{
+	GLMbinheader* header = (GLMbinheader*)filemap->data;
+	GLMbingroup* groups;
+	GLMbinmaterial* materials;
+	GLMtriangle* triangles;
+	GLuint* grouptriangles;
+	size_t size = filemap->size;
+	GLuint i, j;
+
+	if (size < sizeof(GLMbinheader) || !glmLittleEndian())
+		return GL_FALSE;
+	if (memcmp(header->magic, GLM_BIN_MAGIC, 4) || header->version != GLM_BIN_VERSION ||
+		header->size != size)
+		return GL_FALSE;
+
+	/* the 1-based arrays hold count + 1 elements, a count of 0xffffffff
+	   would wrap to 0 and pass every check below */
+	if (header->numvertices == 0xffffffff || header->numnormals == 0xffffffff ||
+		header->numtexcoords == 0xffffffff || header->numfacetnorms == 0xffffffff)
+		return GL_FALSE;
+	if (!glmCheckSection(size, header->vertices, header->numvertices + 1, 3 * sizeof(GLfloat), GL_TRUE) ||
+		!glmCheckSection(size, header->normals, header->numnormals + 1, 3 * sizeof(GLfloat), header->numnormals > 0) ||
+		!glmCheckSection(size, header->texcoords, header->numtexcoords + 1, 2 * sizeof(GLfloat), header->numtexcoords > 0) ||
+		!glmCheckSection(size, header->facetnorms, header->numfacetnorms + 1, 3 * sizeof(GLfloat), header->numfacetnorms > 0) ||
+		!glmCheckSection(size, header->triangles, header->numtriangles, sizeof(GLMtriangle), header->numtriangles > 0) ||
+		!glmCheckSection(size, header->grouptriangles, header->numgrouptriangles, sizeof(GLuint), header->numgrouptriangles > 0) ||
+		!glmCheckSection(size, header->groups, header->numgroups, sizeof(GLMbingroup), header->numgroups > 0) ||
+		!glmCheckSection(size, header->materials, header->nummaterials, sizeof(GLMbinmaterial), header->nummaterials > 0) ||
+		!glmCheckSection(size, header->strings, header->stringsize, 1, header->stringsize > 0))
+		return GL_FALSE;
+
+	/* names must be terminated within the string table */
+	if (header->stringsize && filemap->data[header->strings + header->stringsize - 1] != '\0')
+		return GL_FALSE;
+	if (header->mtllibname != GLM_BIN_NONE && header->mtllibname >= header->stringsize)
+		return GL_FALSE;
+	/* models without materials leave the groups at material 0 */
+	groups = (GLMbingroup*)(filemap->data + header->groups);
+	for (i = 0; i < header->numgroups; i++) {
+		if (groups[i].name >= header->stringsize ||
+			groups[i].first > header->numgrouptriangles ||
+			groups[i].numtriangles > header->numgrouptriangles - groups[i].first ||
+			(header->nummaterials ? groups[i].material >= header->nummaterials : groups[i].material != 0))
+			return GL_FALSE;
+	}
+	grouptriangles = (GLuint*)(filemap->data + header->grouptriangles);
+	for (i = 0; i < header->numgrouptriangles; i++) {
+		if (grouptriangles[i] >= header->numtriangles)
+			return GL_FALSE;
+	}
+
+	/* the arrays are 1-based, index 0 is the unused first element */
+	triangles = (GLMtriangle*)(filemap->data + header->triangles);
+	for (i = 0; i < header->numtriangles; i++) {
+		for (j = 0; j < 3; j++) {
+			if (triangles[i].vindices[j] > header->numvertices ||
+				triangles[i].nindices[j] > header->numnormals ||
+				triangles[i].tindices[j] > header->numtexcoords)
+				return GL_FALSE;
+		}
+		if (triangles[i].findex > header->numfacetnorms)
+			return GL_FALSE;
+	}
+	materials = (GLMbinmaterial*)(filemap->data + header->materials);
+	for (i = 0; i < header->nummaterials; i++) {
+		if (materials[i].name >= header->stringsize)
+			return GL_FALSE;
+	}
+
+	return GL_TRUE;
+}
+
+/* glmMaterialsCurrent: returns GL_TRUE if the materials baked into the
+* binary model are at least as new as its material library.  A missing
+* library is fine, reading the .obj again wouldn't find it either.
+*
+* model   - model read by glmReadBIN
+* binname - name of the binary model file
+*/
+static GLboolean
+glmMaterialsCurrent(GLMmodel* model, char* binname)
+{
+	char* dir;
+	char* mtlname;
+	struct stat st;
+	GLboolean current;
+
+	if (!model->mtllibname)
+		return GL_TRUE;
+
+	dir = glmDirName(binname);
+	mtlname = (char*)malloc(strlen(dir) + strlen(model->mtllibname) + 1);
+	strcpy(mtlname, dir);
+	strcat(mtlname, model->mtllibname);
+	free(dir);
+
+	current = stat(mtlname, &st) != 0 || glmNewer(binname, mtlname);
+	free(mtlname);
+	return current;
+}
+
+/* glmWriteSection: write a section of a binary model file, padding
+* the file with zeros up to the offset of the section
+*
+* file   - file opened for writing
+* pos    - bytes written so far, updated on return
+* offset - offset of the section
+* data   - contents of the section (may be NULL if size is 0)
+* size   - size of the section in bytes
+*/
+static GLvoid
+glmWriteSection(FILE* file, size_t* pos, GLuint offset, const GLvoid* data, size_t size)
+{
+	static const char zeros[16] = { 0 };
+
+	if (!offset)
+		return;
+	assert(*pos <= offset && offset - *pos < sizeof(zeros));
+	fwrite(zeros, 1, offset - *pos, file);
+	if (size)
+		fwrite(data, 1, size, file);
+	*pos = offset + size;
+}
+
+
+/* glmGrow: make sure a malloc'd array can hold at least needed
+* elements, doubling its capacity when it can't.
+*
+* array    - array to grow (may be NULL)
+* capacity - current capacity in elements, updated on return
+* needed   - number of elements that must fit
+* size     - size of one element in bytes
+*/
+static GLvoid*
+glmGrow(GLvoid* array, GLuint* capacity, GLuint needed, size_t size)
+{
+	if (needed <= *capacity && array)
+		return array;
+	while (*capacity < needed)
+		*capacity = *capacity ? *capacity * 2 : 256;
+	array = realloc(array, size * *capacity);
+	if (!array) {
+		fprintf(stderr, "glmGrow() failed: out of memory.\n");
+		exit(1);
+	}
+	return array;
+}
+
+/* glmSkipSpace: skip blanks (but not the end of the line) */
+static const char*
+glmSkipSpace(const char* p, const char* end)
+{
+	while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+		p++;
+	return p;
+}
+
+/* glmSkipLine: skip to the beginning of the next line */
+static const char*
+glmSkipLine(const char* p, const char* end)
+{
+	while (p < end && *p != '\n')
+		p++;
+	return p < end ? p + 1 : end;
+}
+
+/* glmParseWord: find the extent of the next blank separated word on
+* the current line.  Returns its beginning, *wordend is set to its end.
+*/
+static const char*
+glmParseWord(const char* p, const char* end, const char** wordend)
+{
+	const char* q;
+
+	p = glmSkipSpace(p, end);
+	q = p;
+	while (q < end && *q != ' ' && *q != '\t' && *q != '\r' && *q != '\n')
+		q++;
+	*wordend = q;
+	return p;
+}
+
+/* glmCopyWord: copy a word into a NUL terminated buffer of size
+* bytes, truncating it if it doesn't fit.
+*/
+static GLvoid
+glmCopyWord(char* buf, size_t size, const char* word, const char* wordend)
+{
+	size_t len = wordend - word;
+
+	if (len > size - 1)
+		len = size - 1;
+	memcpy(buf, word, len);
+	buf[len] = '\0';
+}
+
+/* glmParseInt: parse a decimal integer.  Returns the position after
+* the integer, or NULL if there is no integer at p.
+*/
+static const char*
+glmParseInt(const char* p, const char* end, int* value)
+{
+	int sign = 1;
+	int v = 0;
+	const char* start;
+
+	if (p < end && (*p == '-' || *p == '+')) {
+		if (*p == '-')
+			sign = -1;
+		p++;
+	}
+	start = p;
+	while (p < end && *p >= '0' && *p <= '9')
+		v = v * 10 + (*p++ - '0');
+	if (p == start)
+		return NULL;
+	*value = sign * v;
+	return p;
+}
+
+/* glmParseFloat: parse a decimal floating point number.  Returns the
+* position after the number, or NULL if there is no number at p.
+* Mantissas of up to 19 digits with small exponents are converted
+* exactly, anything else falls back to strtod().
+*/
+static const char*
+glmParseFloat(const char* p, const char* end, GLfloat* value)
+{
+	static const double pow10[] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+	};
+	const char* start = p;
+	unsigned long long mantissa = 0;
+	int digits = 0, exponent = 0, e = 0, esign = 1;
+	GLboolean negative = GL_FALSE, any = GL_FALSE;
+	double d;
+
+	if (p < end && (*p == '-' || *p == '+')) {
+		negative = (*p == '-');
+		p++;
+	}
+	while (p < end && *p >= '0' && *p <= '9') {
+		if (digits < 19) {
+			mantissa = mantissa * 10 + (*p - '0');
+			if (mantissa)
+				digits++;
+		}
+		else {
+			exponent++;
+		}
+		p++;
+		any = GL_TRUE;
+	}
+	if (p < end && *p == '.') {
+		p++;
+		while (p < end && *p >= '0' && *p <= '9') {
+			if (digits < 19) {
+				mantissa = mantissa * 10 + (*p - '0');
+				if (mantissa)
+					digits++;
+				exponent--;
+			}
+			p++;
+			any = GL_TRUE;
+		}
+	}
+	if (!any)
+		goto fallback;
+	if (p < end && (*p == 'e' || *p == 'E')) {
+		const char* q = p + 1;
+		if (q < end && (*q == '-' || *q == '+')) {
+			if (*q == '-')
+				esign = -1;
+			q++;
+		}
+		if (q < end && *q >= '0' && *q <= '9') {
+			while (q < end && *q >= '0' && *q <= '9') {
+				if (e < 10000)
+					e = e * 10 + (*q - '0');
+				q++;
+			}
+			exponent += esign * e;
+			p = q;
+		}
+	}
+
+	if (mantissa < (1ULL << 53) && exponent >= -22 && exponent <= 22) {
+		d = (double)mantissa;
+		d = exponent < 0 ? d / pow10[-exponent] : d * pow10[exponent];
+		*value = (GLfloat)(negative ? -d : d);
+		return p;
+	}
+
+fallback:
+	/* long mantissas, huge exponents, inf and nan */
+	{
+		char buf[64];
+		char* q;
+		size_t n = 0;
+
+		p = start;
+		while (p + n < end && n < sizeof(buf) - 1 && p[n] != ' ' && p[n] != '\t' &&
+			p[n] != '\r' && p[n] != '\n' && p[n] != '/')
+			n++;
+		memcpy(buf, p, n);
+		buf[n] = '\0';
+		d = strtod(buf, &q);
+		if (q == buf)
+			return NULL;
+		*value = (GLfloat)d;
+		return p + (q - buf);
+	}
+}
+
+/* glmParseFloats: parse up to n floats from the current line into
+* values, missing ones are set to 0.
+*/
+static const char*
+glmParseFloats(const char* p, const char* end, GLfloat* values, int n)
+{
+	const char* q;
+	int i;
+
+	for (i = 0; i < n; i++) {
+		values[i] = 0.0;
+		p = glmSkipSpace(p, end);
+		q = glmParseFloat(p, end, &values[i]);
+		if (q)
+			p = q;
+	}
+	return p;
+}
+
+/* glmParseChunk: parse the lines in [chunk->begin, chunk->end) of a
+* Wavefront OBJ file held in memory.  Chunks are parsed independently
+* (and in parallel), so vertex indices of faces are kept relative to
+* the chunk where needed and group/material statements are recorded
+* as events, both are resolved by glmMergeChunks.
+*
+* chunk - chunk with begin and end set, everything else zeroed
+*/
+static GLvoid
+glmParseChunk(GLMchunk* chunk)
+{
+	const char* p = chunk->begin;
+	const char* end = chunk->end;
+	const char* word;
+	const char* wordend;
+	size_t len;
+	GLuint i;
+
+	/* guess the initial capacities from the chunk size (a vertex line
+	takes about 30 bytes), the arrays grow if the guess is too small */
+	chunk->maxvertices = chunk->maxtriangles = (GLuint)((end - p) / 64) + 1;
+	chunk->vertices = (GLfloat*)glmGrow(NULL, &chunk->maxvertices, 1, 3 * sizeof(GLfloat));
+	chunk->triangles = (GLMtriangle*)glmGrow(NULL, &chunk->maxtriangles, 1, sizeof(GLMtriangle));
+
+	while (p < end) {
+		word = glmParseWord(p, end, &wordend);
+		len = wordend - word;
+		p = wordend;
+
+		if (len == 1 && word[0] == 'v') {               /* vertex */
+			chunk->vertices = (GLfloat*)glmGrow(chunk->vertices, &chunk->maxvertices,
+				chunk->numvertices + 1, 3 * sizeof(GLfloat));
+			p = glmParseFloats(p, end, &chunk->vertices[3 * chunk->numvertices], 3);
+			chunk->numvertices++;
+		}
+		else if (len == 2 && word[0] == 'v' && word[1] == 'n') {  /* normal */
+			chunk->normals = (GLfloat*)glmGrow(chunk->normals, &chunk->maxnormals,
+				chunk->numnormals + 1, 3 * sizeof(GLfloat));
+			p = glmParseFloats(p, end, &chunk->normals[3 * chunk->numnormals], 3);
+			chunk->numnormals++;
+		}
+		else if (len == 2 && word[0] == 'v' && word[1] == 't') {  /* texcoord */
+			chunk->texcoords = (GLfloat*)glmGrow(chunk->texcoords, &chunk->maxtexcoords,
+				chunk->numtexcoords + 1, 2 * sizeof(GLfloat));
+			p = glmParseFloats(p, end, &chunk->texcoords[2 * chunk->numtexcoords], 2);
+			chunk->numtexcoords++;
+		}
+		else if (len == 1 && word[0] == 'f') {          /* face */
+			GLint corner[3][3];    /* first, previous and current v/t/n */
+			GLuint ncorners = 0;
+
+			for (;;) {
+				int v = 0, t = 0, n = 0;
+				const char* q;
+
+				p = glmSkipSpace(p, end);
+				q = glmParseInt(p, end, &v);
+				if (!q)
+					break;
+				/* can be one of %d, %d//%d, %d/%d, %d/%d/%d */
+				if (q < end && *q == '/') {
+					q++;
+					if (q < end && *q != '/')
+						q = glmParseInt(q, end, &t);
+					if (q && q < end && *q == '/')
+						q = glmParseInt(q + 1, end, &n);
+					if (!q)
+						break;
+				}
+				p = q;
+
+				/* negative indices count back from the last element read,
+				the element can be in a preceding chunk so they're kept
+				relative to the chunk start (offset by GLM_RELATIVE, which
+				makes them negative) until glmMergeChunks rebases them */
+				corner[2][0] = v < 0 ? (GLint)(v + chunk->numvertices + 1) - GLM_RELATIVE : v;
+				corner[2][1] = t < 0 ? (GLint)(t + chunk->numtexcoords + 1) - GLM_RELATIVE : t;
+				corner[2][2] = n < 0 ? (GLint)(n + chunk->numnormals + 1) - GLM_RELATIVE : n;
+				ncorners++;
+				if (ncorners == 1)
+					memcpy(corner[0], corner[2], sizeof(corner[2]));
+
+				/* triangulate polygons as a fan around the first corner */
+				if (ncorners >= 3) {
+					GLMtriangle* triangle;
+
+					chunk->triangles = (GLMtriangle*)glmGrow(chunk->triangles, &chunk->maxtriangles,
+						chunk->numtriangles + 1, sizeof(GLMtriangle));
+					triangle = &chunk->triangles[chunk->numtriangles];
+					for (i = 0; i < 3; i++) {
+						triangle->vindices[i] = (GLuint)corner[i][0];
+						triangle->tindices[i] = (GLuint)corner[i][1];
+						triangle->nindices[i] = (GLuint)corner[i][2];
+					}
+					triangle->findex = 0;
+					chunk->numtriangles++;
+				}
+				memcpy(corner[1], corner[2], sizeof(corner[2]));
+			}
+		}
+		else if ((len == 1 && word[0] == 'g') ||            /* group */
+			(len == 6 && !strncmp(word, "usemtl", 6)) ||
+			(len == 6 && !strncmp(word, "mtllib", 6))) {
+			GLMevent* event;
+
+			chunk->events = (GLMevent*)glmGrow(chunk->events, &chunk->maxevents,
+				chunk->numevents + 1, sizeof(GLMevent));
+			event = &chunk->events[chunk->numevents++];
+			event->type = word[0];
+			event->triangle = chunk->numtriangles;
+
+			if (word[0] == 'g') {
+				/* group names run to the end of the line */
+				word = glmSkipSpace(p, end);
+				wordend = word;
+				while (wordend < end && *wordend != '\n')
+					wordend++;
+				p = wordend;
+#if SINGLE_STRING_GROUP_NAMES
+				glmParseWord(word, end, &wordend);
+#endif
+				while (wordend > word && (wordend[-1] == ' ' || wordend[-1] == '\t' || wordend[-1] == '\r'))
+					wordend--;
+			}
+			else {
+				word = glmParseWord(p, end, &wordend);
+			}
+			event->name = word;
+			event->nameend = wordend;
+		}
+
+		/* comments, unknown statements and the rest of the line */
+		p = glmSkipLine(p, end);
+	}
+}
+
+/* glmMergeChunks: merge the chunks of an OBJ file, in file order, into
+* the model.  Element arrays are concatenated, chunk relative face
+* indices are offset by the elements of the preceding chunks, and the
+* group/material events are replayed in order to assign triangles to
+* groups, so the result is the same as parsing the file in one piece.
 *
-* model - properly initialized GLMmodel structure
-* file  - (fopen'd) file descriptor
+* model     - properly initialized GLMmodel structure
+* chunks    - parsed chunks
+* numchunks - number of chunks
 */
 static GLvoid
-glmFirstPass(GLMmodel* model, FILE* file)
+glmMergeChunks(GLMmodel* model, GLMchunk* chunks, int numchunks)
 {
-	GLuint numvertices;        /* number of vertices in model */
-	GLuint numnormals;         /* number of normals in model */
-	GLuint numtexcoords;       /* number of texcoords in model */
-	GLuint numtriangles;       /* number of triangles in model */
+	GLMgroup** tgroups;        /* group of each triangle */
 	GLMgroup* group;           /* current group */
-	int v, n, t;
-	char buf[128];
+	GLuint material;           /* current material */
+	char name[128];
+	GLuint i;
+	int c;
+
+	/* element offsets of each chunk */
+	for (c = 0; c < numchunks; c++) {
+		GLMchunk* prev = c ? &chunks[c - 1] : NULL;
+		chunks[c].basevertices = prev ? prev->basevertices + prev->numvertices : 0;
+		chunks[c].basenormals = prev ? prev->basenormals + prev->numnormals : 0;
+		chunks[c].basetexcoords = prev ? prev->basetexcoords + prev->numtexcoords : 0;
+		chunks[c].basetriangles = prev ? prev->basetriangles + prev->numtriangles : 0;
+	}
+	model->numvertices = chunks[numchunks - 1].basevertices + chunks[numchunks - 1].numvertices;
+	model->numnormals = chunks[numchunks - 1].basenormals + chunks[numchunks - 1].numnormals;
+	model->numtexcoords = chunks[numchunks - 1].basetexcoords + chunks[numchunks - 1].numtexcoords;
+	model->numtriangles = chunks[numchunks - 1].basetriangles + chunks[numchunks - 1].numtriangles;
+
+	/* keep normals and texcoords NULL if the file has none */
+	model->vertices = (GLfloat*)malloc(sizeof(GLfloat) * 3 * (model->numvertices + 1));
+	model->normals = model->numnormals ?
+		(GLfloat*)malloc(sizeof(GLfloat) * 3 * (model->numnormals + 1)) : NULL;
+	model->texcoords = model->numtexcoords ?
+		(GLfloat*)malloc(sizeof(GLfloat) * 2 * (model->numtexcoords + 1)) : NULL;
+	model->triangles = (GLMtriangle*)malloc(sizeof(GLMtriangle) *
+		(model->numtriangles ? model->numtriangles : 1));
+	tgroups = (GLMgroup**)malloc(sizeof(GLMgroup*) * (model->numtriangles ? model->numtriangles : 1));
 
-	/* make a default group */
+	/* replay the group and material statements in file order, this
+	can't be done in parallel since materials must be read before they
+	are used and groups are created in order */
 	group = glmAddGroup(model, "glm_default");
-
-	numvertices = numnormals = numtexcoords = numtriangles = 0;
-	while (fscanf(file, "%s", buf) != EOF) {
-		switch (buf[0]) {
-		case '#':               /* comment */
-			/* eat up rest of line */
-			fgets(buf, sizeof(buf), file);
-			break;
-		case 'v':               /* v, vn, vt */
-			switch (buf[1]) {
-			case '\0':          /* vertex */
-				/* eat up rest of line */
-				fgets(buf, sizeof(buf), file);
-				numvertices++;
-				break;
-			case 'n':           /* normal */
-				/* eat up rest of line */
-				fgets(buf, sizeof(buf), file);
-				numnormals++;
+	material = 0;
+	for (c = 0; c < numchunks; c++) {
+		chunks[c].group = group;
+		for (i = 0; i < chunks[c].numevents; i++) {
+			GLMevent* event = &chunks[c].events[i];
+			glmCopyWord(name, sizeof(name), event->name, event->nameend);
+			switch (event->type) {
+			case 'g':
+				group = glmAddGroup(model, name);
+				group->material = material;
 				break;
-			case 't':           /* texcoord */
-				/* eat up rest of line */
-				fgets(buf, sizeof(buf), file);
-				numtexcoords++;
+			case 'u':
+				group->material = material = glmFindMaterial(model, name);
 				break;
-			default:
-				printf("glmFirstPass(): Unknown token \"%s\".\n", buf);
-				exit(1);
+			case 'm':
+				model->mtllibname = strdup(name);
+				glmReadMTL(model, name);
 				break;
 			}
-			break;
-		case 'm':
-			fgets(buf, sizeof(buf), file);
-			sscanf(buf, "%s %s", buf, buf);
-			model->mtllibname = strdup(buf);
-			glmReadMTL(model, buf);
-			break;
-		case 'u':
-			/* eat up rest of line */
-			fgets(buf, sizeof(buf), file);
-			break;
-		case 'g':               /* group */
-			/* eat up rest of line */
-			fgets(buf, sizeof(buf), file);
-#if SINGLE_STRING_GROUP_NAMES
-			sscanf(buf, "%s", buf);
-#else
-			buf[strlen(buf) - 1] = '\0';  /* nuke '\n' */
-#endif
-			group = glmAddGroup(model, buf);
-			break;
-		case 'f':               /* face */
-			v = n = t = 0;
-			fscanf(file, "%s", buf);
-			/* can be one of %d, %d//%d, %d/%d, %d/%d/%d %d//%d */
-			if (strstr(buf, "//")) {
-				/* v//n */
-				sscanf(buf, "%d//%d", &v, &n);
-				fscanf(file, "%d//%d", &v, &n);
-				fscanf(file, "%d//%d", &v, &n);
-				numtriangles++;
-				group->numtriangles++;
-				while (fscanf(file, "%d//%d", &v, &n) > 0) {
-					numtriangles++;
-					group->numtriangles++;
-				}
-			}
-			else if (sscanf(buf, "%d/%d/%d", &v, &t, &n) == 3) {
-				/* v/t/n */
-				fscanf(file, "%d/%d/%d", &v, &t, &n);
-				fscanf(file, "%d/%d/%d", &v, &t, &n);
-				numtriangles++;
-				group->numtriangles++;
-				while (fscanf(file, "%d/%d/%d", &v, &t, &n) > 0) {
-					numtriangles++;
-					group->numtriangles++;
-				}
-			}
-			else if (sscanf(buf, "%d/%d", &v, &t) == 2) {
-				/* v/t */
-				fscanf(file, "%d/%d", &v, &t);
-				fscanf(file, "%d/%d", &v, &t);
-				numtriangles++;
-				group->numtriangles++;
-				while (fscanf(file, "%d/%d", &v, &t) > 0) {
-					numtriangles++;
-					group->numtriangles++;
-				}
-			}
-			else {
-				/* v */
-				fscanf(file, "%d", &v);
-				fscanf(file, "%d", &v);
-				numtriangles++;
-				group->numtriangles++;
-				while (fscanf(file, "%d", &v) > 0) {
-					numtriangles++;
-					group->numtriangles++;
-				}
-			}
-			break;
-
-		default:
-			/* eat up rest of line */
-			fgets(buf, sizeof(buf), file);
-			break;
+			event->group = group;
 		}
 	}
 
-	/* set the stats in the model structure */
-	model->numvertices = numvertices;
-	model->numnormals = numnormals;
-	model->numtexcoords = numtexcoords;
-	model->numtriangles = numtriangles;
+	/* copy the elements and offset the face indices */
+#pragma omp parallel for schedule(dynamic)
+	for (c = 0; c < numchunks; c++) {
+		GLMchunk* chunk = &chunks[c];
+		GLMgroup* current = chunk->group;
+		GLuint e = 0, t, k;
+
+		memcpy(&model->vertices[3 * (chunk->basevertices + 1)], chunk->vertices,
+			sizeof(GLfloat) * 3 * chunk->numvertices);
+		if (chunk->numnormals)
+			memcpy(&model->normals[3 * (chunk->basenormals + 1)], chunk->normals,
+			sizeof(GLfloat) * 3 * chunk->numnormals);
+		if (chunk->numtexcoords)
+			memcpy(&model->texcoords[2 * (chunk->basetexcoords + 1)], chunk->texcoords,
+			sizeof(GLfloat) * 2 * chunk->numtexcoords);
+
+		for (t = 0; t < chunk->numtriangles; t++) {
+			GLMtriangle* src = &chunk->triangles[t];
+			GLMtriangle* dst = &model->triangles[chunk->basetriangles + t];
+
+			while (e < chunk->numevents && chunk->events[e].triangle <= t)
+				current = chunk->events[e++].group;
+			for (k = 0; k < 3; k++) {
+				GLint v = (GLint)src->vindices[k];
+				GLint tc = (GLint)src->tindices[k];
+				GLint n = (GLint)src->nindices[k];
+				dst->vindices[k] = v < 0 ? chunk->basevertices + (v + GLM_RELATIVE) : v;
+				dst->tindices[k] = tc < 0 ? chunk->basetexcoords + (tc + GLM_RELATIVE) : tc;
+				dst->nindices[k] = n < 0 ? chunk->basenormals + (n + GLM_RELATIVE) : n;
+			}
+			dst->findex = 0;
+			tgroups[chunk->basetriangles + t] = current;
+		}
+
+		free(chunk->vertices);
+		free(chunk->normals);
+		free(chunk->texcoords);
+		free(chunk->triangles);
+		free(chunk->events);
+	}
 
-	/* allocate memory for the triangles in each group */
-	group = model->groups;
-	while (group) {
+	/* fill the triangle lists of the groups in file order */
+	for (group = model->groups; group; group = group->next)
+		group->numtriangles = 0;
+	for (i = 0; i < model->numtriangles; i++)
+		tgroups[i]->numtriangles++;
+	for (group = model->groups; group; group = group->next) {
 		group->triangles = (GLuint*)malloc(sizeof(GLuint) * group->numtriangles);
 		group->numtriangles = 0;
-		group = group->next;
 	}
+	for (i = 0; i < model->numtriangles; i++)
+		tgroups[i]->triangles[tgroups[i]->numtriangles++] = i;
+	free(tgroups);
 }
 
-/* glmSecondPass: second pass at a Wavefront OBJ file that gets all
-* the data.
+/* glmParseOBJ: read a Wavefront OBJ file held in memory.  The file is
+* split at line boundaries into chunks that are parsed in parallel
+* (when compiled with OpenMP) and then merged in file order.
 *
 * model - properly initialized GLMmodel structure
-* file  - (fopen'd) file descriptor
+* p     - beginning of the file contents
+* end   - end of the file contents
 */
 static GLvoid
-glmSecondPass(GLMmodel* model, FILE* file)
-{
-	GLuint numvertices;        /* number of vertices in model */
-	GLuint numnormals;         /* number of normals in model */
-	GLuint numtexcoords;       /* number of texcoords in model */
-	GLuint numtriangles;       /* number of triangles in model */
-	GLfloat* vertices;         /* array of vertices  */
-	GLfloat* normals;          /* array of normals */
-	GLfloat* texcoords;        /* array of texture coordinates */
-	GLMgroup* group;           /* current group pointer */
-	GLuint material;           /* current material */
-	int v, n, t;
-	char buf[128];
-
-	/* set the pointer shortcuts */
-	vertices = model->vertices;
-	normals = model->normals;
-	texcoords = model->texcoords;
-	group = model->groups;
-
-	/* on the second pass through the file, read all the data into the
-	allocated arrays */
-	numvertices = numnormals = numtexcoords = 1;
-	numtriangles = 0;
-	material = 0;
-	while (fscanf(file, "%s", buf) != EOF) {
-		switch (buf[0]) {
-		case '#':               /* comment */
-			/* eat up rest of line */
-			fgets(buf, sizeof(buf), file);
-			break;
-		case 'v':               /* v, vn, vt */
-			switch (buf[1]) {
-			case '\0':          /* vertex */
-				fscanf(file, "%f %f %f",
-					&vertices[3 * numvertices + 0],
-					&vertices[3 * numvertices + 1],
-					&vertices[3 * numvertices + 2]);
-				numvertices++;
-				break;
-			case 'n':           /* normal */
-				fscanf(file, "%f %f %f",
-					&normals[3 * numnormals + 0],
-					&normals[3 * numnormals + 1],
-					&normals[3 * numnormals + 2]);
-				numnormals++;
-				break;
-			case 't':           /* texcoord */
-				fscanf(file, "%f %f",
-					&texcoords[2 * numtexcoords + 0],
-					&texcoords[2 * numtexcoords + 1]);
-				numtexcoords++;
-				break;
-			}
-			break;
-		case 'u':
-			fgets(buf, sizeof(buf), file);
-			sscanf(buf, "%s %s", buf, buf);
-			group->material = material = glmFindMaterial(model, buf);
-			break;
-		case 'g':               /* group */
-			/* eat up rest of line */
-			fgets(buf, sizeof(buf), file);
-#if SINGLE_STRING_GROUP_NAMES
-			sscanf(buf, "%s", buf);
-#else
-			buf[strlen(buf) - 1] = '\0';  /* nuke '\n' */
-#endif
-			group = glmFindGroup(model, buf);
-			group->material = material;
-			break;
-		case 'f':               /* face */
-			v = n = t = 0;
-			fscanf(file, "%s", buf);
-			/* can be one of %d, %d//%d, %d/%d, %d/%d/%d %d//%d */
-			if (strstr(buf, "//")) {
-				/* v//n */
-				sscanf(buf, "%d//%d", &v, &n);
-				T(numtriangles).vindices[0] = v < 0 ? v + numvertices : v;
-				T(numtriangles).nindices[0] = n < 0 ? n + numnormals : n;
-				fscanf(file, "%d//%d", &v, &n);
-				T(numtriangles).vindices[1] = v < 0 ? v + numvertices : v;
-				T(numtriangles).nindices[1] = n < 0 ? n + numnormals : n;
-				fscanf(file, "%d//%d", &v, &n);
-				T(numtriangles).vindices[2] = v < 0 ? v + numvertices : v;
-				T(numtriangles).nindices[2] = n < 0 ? n + numnormals : n;
-				group->triangles[group->numtriangles++] = numtriangles;
-				numtriangles++;
-				while (fscanf(file, "%d//%d", &v, &n) > 0) {
-					T(numtriangles).vindices[0] = T(numtriangles - 1).vindices[0];
-					T(numtriangles).nindices[0] = T(numtriangles - 1).nindices[0];
-					T(numtriangles).vindices[1] = T(numtriangles - 1).vindices[2];
-					T(numtriangles).nindices[1] = T(numtriangles - 1).nindices[2];
-					T(numtriangles).vindices[2] = v < 0 ? v + numvertices : v;
-					T(numtriangles).nindices[2] = n < 0 ? n + numnormals : n;
-					group->triangles[group->numtriangles++] = numtriangles;
-					numtriangles++;
-				}
-			}
-			else if (sscanf(buf, "%d/%d/%d", &v, &t, &n) == 3) {
-				/* v/t/n */
-				T(numtriangles).vindices[0] = v < 0 ? v + numvertices : v;
-				T(numtriangles).tindices[0] = t < 0 ? t + numtexcoords : t;
-				T(numtriangles).nindices[0] = n < 0 ? n + numnormals : n;
-				fscanf(file, "%d/%d/%d", &v, &t, &n);
-				T(numtriangles).vindices[1] = v < 0 ? v + numvertices : v;
-				T(numtriangles).tindices[1] = t < 0 ? t + numtexcoords : t;
-				T(numtriangles).nindices[1] = n < 0 ? n + numnormals : n;
-				fscanf(file, "%d/%d/%d", &v, &t, &n);
-				T(numtriangles).vindices[2] = v < 0 ? v + numvertices : v;
-				T(numtriangles).tindices[2] = t < 0 ? t + numtexcoords : t;
-				T(numtriangles).nindices[2] = n < 0 ? n + numnormals : n;
-				group->triangles[group->numtriangles++] = numtriangles;
-				numtriangles++;
-				while (fscanf(file, "%d/%d/%d", &v, &t, &n) > 0) {
-					T(numtriangles).vindices[0] = T(numtriangles - 1).vindices[0];
-					T(numtriangles).tindices[0] = T(numtriangles - 1).tindices[0];
-					T(numtriangles).nindices[0] = T(numtriangles - 1).nindices[0];
-					T(numtriangles).vindices[1] = T(numtriangles - 1).vindices[2];
-					T(numtriangles).tindices[1] = T(numtriangles - 1).tindices[2];
-					T(numtriangles).nindices[1] = T(numtriangles - 1).nindices[2];
-					T(numtriangles).vindices[2] = v < 0 ? v + numvertices : v;
-					T(numtriangles).tindices[2] = t < 0 ? t + numtexcoords : t;
-					T(numtriangles).nindices[2] = n < 0 ? n + numnormals : n;
-					group->triangles[group->numtriangles++] = numtriangles;
-					numtriangles++;
-				}
-			}
-			else if (sscanf(buf, "%d/%d", &v, &t) == 2) {
-				/* v/t */
-				T(numtriangles).vindices[0] = v < 0 ? v + numvertices : v;
-				T(numtriangles).tindices[0] = t < 0 ? t + numtexcoords : t;
-				fscanf(file, "%d/%d", &v, &t);
-				T(numtriangles).vindices[1] = v < 0 ? v + numvertices : v;
-				T(numtriangles).tindices[1] = t < 0 ? t + numtexcoords : t;
-				fscanf(file, "%d/%d", &v, &t);
-				T(numtriangles).vindices[2] = v < 0 ? v + numvertices : v;
-				T(numtriangles).tindices[2] = t < 0 ? t + numtexcoords : t;
-				group->triangles[group->numtriangles++] = numtriangles;
-				numtriangles++;
-				while (fscanf(file, "%d/%d", &v, &t) > 0) {
-					T(numtriangles).vindices[0] = T(numtriangles - 1).vindices[0];
-					T(numtriangles).tindices[0] = T(numtriangles - 1).tindices[0];
-					T(numtriangles).vindices[1] = T(numtriangles - 1).vindices[2];
-					T(numtriangles).tindices[1] = T(numtriangles - 1).tindices[2];
-					T(numtriangles).vindices[2] = v < 0 ? v + numvertices : v;
-					T(numtriangles).tindices[2] = t < 0 ? t + numtexcoords : t;
-					group->triangles[group->numtriangles++] = numtriangles;
-					numtriangles++;
-				}
-			}
-			else {
-				/* v */
-				sscanf(buf, "%d", &v);
-				T(numtriangles).vindices[0] = v < 0 ? v + numvertices : v;
-				fscanf(file, "%d", &v);
-				T(numtriangles).vindices[1] = v < 0 ? v + numvertices : v;
-				fscanf(file, "%d", &v);
-				T(numtriangles).vindices[2] = v < 0 ? v + numvertices : v;
-				group->triangles[group->numtriangles++] = numtriangles;
-				numtriangles++;
-				while (fscanf(file, "%d", &v) > 0) {
-					T(numtriangles).vindices[0] = T(numtriangles - 1).vindices[0];
-					T(numtriangles).vindices[1] = T(numtriangles - 1).vindices[2];
-					T(numtriangles).vindices[2] = v < 0 ? v + numvertices : v;
-					group->triangles[group->numtriangles++] = numtriangles;
-					numtriangles++;
-				}
-			}
-			break;
-
-		default:
-			/* eat up rest of line */
-			fgets(buf, sizeof(buf), file);
-			break;
-		}
-	}
-
-#if 0
-	/* announce the memory requirements */
-	printf(" Memory: %d bytes\n",
-		numvertices * 3 * sizeof(GLfloat) +
-		numnormals * 3 * sizeof(GLfloat) * (numnormals ? 1 : 0) +
-		numtexcoords * 3 * sizeof(GLfloat) * (numtexcoords ? 1 : 0) +
-		numtriangles * sizeof(GLMtriangle));
+glmParseOBJ(GLMmodel* model, const char* p, const char* end)
+{
+	GLMchunk* chunks;
+	size_t chunksize;
+	int numchunks, maxchunks, c;
+
+	/* a few chunks per thread balance the load, but chunks smaller
+	than GLM_MIN_CHUNK_SIZE aren't worth the merge */
+	maxchunks = 1;
+#ifdef _OPENMP
+	maxchunks = 4 * omp_get_max_threads();
 #endif
+	numchunks = (int)((end - p) / GLM_MIN_CHUNK_SIZE);
+	if (numchunks > maxchunks)
+		numchunks = maxchunks;
+	if (numchunks < 1)
+		numchunks = 1;
+	chunksize = (end - p) / numchunks;
+
+	chunks = (GLMchunk*)calloc(numchunks, sizeof(GLMchunk));
+	for (c = 0; c < numchunks; c++) {
+		chunks[c].begin = c ? chunks[c - 1].end : p;
+		chunks[c].end = c == numchunks - 1 ? end : glmSkipLine(p + chunksize * (c + 1) - 1, end);
+		if (chunks[c].end < chunks[c].begin)
+			chunks[c].end = chunks[c].begin;
+	}
+
+#pragma omp parallel for schedule(dynamic)
+	for (c = 0; c < numchunks; c++)
+		glmParseChunk(&chunks[c]);
+
+	glmMergeChunks(model, chunks, numchunks);
+	free(chunks);
 }
 
 
@@ -788,57 +1879,31 @@ glmSecondPass(GLMmodel* model, FILE* file)
 GLfloat
 glmUnitize(GLMmodel* model)
 {
-	GLuint i;
-	GLfloat maxx, minx, maxy, miny, maxz, minz;
-	GLfloat cx, cy, cz, w, h, d;
+	GLfloat min[3], max[3];
+	GLfloat center[3], w, h, d;
 	GLfloat scale;
 
 	assert(model);
 	assert(model->vertices);
 
 	/* get the max/mins */
-	maxx = minx = model->vertices[3 + 0];
-	maxy = miny = model->vertices[3 + 1];
-	maxz = minz = model->vertices[3 + 2];
-	for (i = 1; i <= model->numvertices; i++) {
-		if (maxx < model->vertices[3 * i + 0])
-			maxx = model->vertices[3 * i + 0];
-		if (minx > model->vertices[3 * i + 0])
-			minx = model->vertices[3 * i + 0];
-
-		if (maxy < model->vertices[3 * i + 1])
-			maxy = model->vertices[3 * i + 1];
-		if (miny > model->vertices[3 * i + 1])
-			miny = model->vertices[3 * i + 1];
-
-		if (maxz < model->vertices[3 * i + 2])
-			maxz = model->vertices[3 * i + 2];
-		if (minz > model->vertices[3 * i + 2])
-			minz = model->vertices[3 * i + 2];
-	}
+	glmBoundingBox(model, min, max);
 
 	/* calculate model width, height, and depth */
-	w = glmAbs(maxx) + glmAbs(minx);
-	h = glmAbs(maxy) + glmAbs(miny);
-	d = glmAbs(maxz) + glmAbs(minz);
+	w = glmAbs(max[0]) + glmAbs(min[0]);
+	h = glmAbs(max[1]) + glmAbs(min[1]);
+	d = glmAbs(max[2]) + glmAbs(min[2]);
 
 	/* calculate center of the model */
-	cx = (maxx + minx) / 2.0;
-	cy = (maxy + miny) / 2.0;
-	cz = (maxz + minz) / 2.0;
+	center[0] = (max[0] + min[0]) / 2.0;
+	center[1] = (max[1] + min[1]) / 2.0;
+	center[2] = (max[2] + min[2]) / 2.0;
 
 	/* calculate unitizing scale factor */
 	scale = 2.0 / glmMax(glmMax(w, h), d);
 
 	/* translate around center then scale */
-	for (i = 1; i <= model->numvertices; i++) {
-		model->vertices[3 * i + 0] -= cx;
-		model->vertices[3 * i + 1] -= cy;
-		model->vertices[3 * i + 2] -= cz;
-		model->vertices[3 * i + 0] *= scale;
-		model->vertices[3 * i + 1] *= scale;
-		model->vertices[3 * i + 2] *= scale;
-	}
+	glmTransform(&model->vertices[3], model->numvertices, center, scale);
 
 	return scale;
 }
@@ -852,38 +1917,43 @@ glmUnitize(GLMmodel* model)
 GLvoid
 glmDimensions(GLMmodel* model, GLfloat* dimensions)
 {
-	GLuint i;
-	GLfloat maxx, minx, maxy, miny, maxz, minz;
+	GLfloat min[3], max[3];
 
 	assert(model);
 	assert(model->vertices);
 	assert(dimensions);
 
 	/* get the max/mins */
-	maxx = minx = model->vertices[3 + 0];
-	maxy = miny = model->vertices[3 + 1];
-	maxz = minz = model->vertices[3 + 2];
-	for (i = 1; i <= model->numvertices; i++) {
-		if (maxx < model->vertices[3 * i + 0])
-			maxx = model->vertices[3 * i + 0];
-		if (minx > model->vertices[3 * i + 0])
-			minx = model->vertices[3 * i + 0];
+	glmBoundingBox(model, min, max);
 
-		if (maxy < model->vertices[3 * i + 1])
-			maxy = model->vertices[3 * i + 1];
-		if (miny > model->vertices[3 * i + 1])
-			miny = model->vertices[3 * i + 1];
+	/* calculate model width, height, and depth */
+	dimensions[0] = glmAbs(max[0]) + glmAbs(min[0]);
+	dimensions[1] = glmAbs(max[1]) + glmAbs(min[1]);
+	dimensions[2] = glmAbs(max[2]) + glmAbs(min[2]);
+}
 
-		if (maxz < model->vertices[3 * i + 2])
-			maxz = model->vertices[3 * i + 2];
-		if (minz > model->vertices[3 * i + 2])
-			minz = model->vertices[3 * i + 2];
-	}
+/* glmBoundingBox: Calculates the axis aligned bounding box of a model.
+*
+* model - initialized GLMmodel structure
+* min   - array of 3 GLfloats, minimum x, y and z on return
+* max   - array of 3 GLfloats, maximum x, y and z on return
+*/
+GLvoid
+glmBoundingBox(GLMmodel* model, GLfloat* min, GLfloat* max)
+{
+	assert(model);
+	assert(model->vertices);
 
-	/* calculate model width, height, and depth */
-	dimensions[0] = glmAbs(maxx) + glmAbs(minx);
-	dimensions[1] = glmAbs(maxy) + glmAbs(miny);
-	dimensions[2] = glmAbs(maxz) + glmAbs(minz);
+	/* start from the first vertex, an empty box is all zeros */
+	if (!model->numvertices) {
+		min[0] = min[1] = min[2] = 0.0;
+		max[0] = max[1] = max[2] = 0.0;
+		return;
+	}
+	min[0] = max[0] = model->vertices[3 + 0];
+	min[1] = max[1] = model->vertices[3 + 1];
+	min[2] = max[2] = model->vertices[3 + 2];
+	glmBounds(&model->vertices[3], model->numvertices, min, max);
 }
 
 /* glmScale: Scales a model by a given amount.
@@ -894,13 +1964,7 @@ glmDimensions(GLMmodel* model, GLfloat* dimensions)
 GLvoid
 glmScale(GLMmodel* model, GLfloat scale)
 {
-	GLuint i;
-
-	for (i = 1; i <= model->numvertices; i++) {
-		model->vertices[3 * i + 0] *= scale;
-		model->vertices[3 * i + 1] *= scale;
-		model->vertices[3 * i + 2] *= scale;
-	}
+	glmTransform(&model->vertices[3], model->numvertices, NULL, scale);
 }
 
 /* glmReverseWinding: Reverse the polygon winding for all polygons in
@@ -958,42 +2022,119 @@ glmReverseWinding(GLMmodel* model)
 GLvoid
 glmFacetNormals(GLMmodel* model)
 {
-	GLuint  i;
-	GLfloat u[3];
-	GLfloat v[3];
+	int n, count;              /* signed for OpenMP */
 
 	assert(model);
 	assert(model->vertices);
 
 	/* clobber any old facetnormals */
 	if (model->facetnorms)
-		free(model->facetnorms);
+		glmFree(model, model->facetnorms);
 
 	/* allocate memory for the new facet normals */
 	model->numfacetnorms = model->numtriangles;
 	model->facetnorms = (GLfloat*)malloc(sizeof(GLfloat) *
 		3 * (model->numfacetnorms + 1));
 
-	for (i = 0; i < model->numtriangles; i++) {
-		model->triangles[i].findex = i + 1;
-
-		u[0] = model->vertices[3 * T(i).vindices[1] + 0] -
-			model->vertices[3 * T(i).vindices[0] + 0];
-		u[1] = model->vertices[3 * T(i).vindices[1] + 1] -
-			model->vertices[3 * T(i).vindices[0] + 1];
-		u[2] = model->vertices[3 * T(i).vindices[1] + 2] -
-			model->vertices[3 * T(i).vindices[0] + 2];
-
-		v[0] = model->vertices[3 * T(i).vindices[2] + 0] -
-			model->vertices[3 * T(i).vindices[0] + 0];
-		v[1] = model->vertices[3 * T(i).vindices[2] + 1] -
-			model->vertices[3 * T(i).vindices[0] + 1];
-		v[2] = model->vertices[3 * T(i).vindices[2] + 2] -
-			model->vertices[3 * T(i).vindices[0] + 2];
+	/* blocks of triangles are independent */
+	count = (int)((model->numtriangles + GLM_BLOCK_SIZE - 1) / GLM_BLOCK_SIZE);
+#pragma omp parallel for
+	for (n = 0; n < count; n++) {
+		GLuint first = n * GLM_BLOCK_SIZE;
+		glmFacetNormalsBlock(model->vertices, model->triangles, model->facetnorms, first,
+			model->numtriangles - first < GLM_BLOCK_SIZE ? model->numtriangles - first : GLM_BLOCK_SIZE);
+	}
+}
 
-		glmCross(u, v, &model->facetnorms[3 * (i + 1)]);
-		glmNormalize(&model->facetnorms[3 * (i + 1)]);
+/* glmSmoothVertex: works out the normals of one vertex for
+* glmVertexNormals.  Returns the number of normals the vertex needs:
+* one for the average of the facet normals within the angle of the
+* first triangle in the list, plus one facet normal for every other
+* triangle.  If normal is not 0 the normals are stored from that
+* index on and the triangles are pointed at them.
+*
+* model     - initialized GLMmodel structure
+* v         - index of the vertex
+* members   - triangles the vertex is in
+* count     - number of triangles in members
+* cos_angle - cosine of the maximum angle to smooth across
+* normal    - index of the first normal of the vertex, 0 to just count
+*/
+static GLuint
+glmSmoothVertex(GLMmodel* model, GLuint v, GLuint* members, GLuint count,
+	GLfloat cos_angle, GLuint normal)
+{
+	GLfloat* facetnorms = model->facetnorms;
+	GLfloat* first;
+	GLfloat* facet;
+	GLfloat average[3];
+	GLMtriangle* triangle;
+	GLuint numnormals, avg, i;
+
+	if (!count)
+		return 0;
+
+	/* only average if the dot product of the angle between the two
+	facet normals is greater than the cosine of the threshold angle --
+	or, said another way, the angle between the two facet normals is
+	less than (or equal to) the threshold angle */
+	first = &facetnorms[3 * T(members[0]).findex];
+	average[0] = 0.0; average[1] = 0.0; average[2] = 0.0;
+	numnormals = 0;
+	avg = 0;
+	for (i = 0; i < count; i++) {
+		facet = &facetnorms[3 * T(members[i]).findex];
+		if (glmDot(facet, first) > cos_angle) {
+			average[0] += facet[0];
+			average[1] += facet[1];
+			average[2] += facet[2];
+			avg = 1;                /* we averaged at least one normal! */
+		}
+		else {
+			numnormals++;
+		}
+	}
+	numnormals += avg;
+	if (!normal)
+		return numnormals;
+
+	if (avg) {
+		/* add the normalized average normal to the vertex normals */
+		glmNormalize(average);
+		model->normals[3 * normal + 0] = average[0];
+		model->normals[3 * normal + 1] = average[1];
+		model->normals[3 * normal + 2] = average[2];
+		avg = normal++;
+	}
+
+	/* set the normal of this vertex in each triangle it is in, the
+	facet normal if it wasn't averaged */
+	for (i = 0; i < count; i++) {
+		triangle = &T(members[i]);
+		facet = &facetnorms[3 * triangle->findex];
+		if (glmDot(facet, first) > cos_angle) {
+			if (triangle->vindices[0] == v)
+				triangle->nindices[0] = avg;
+			else if (triangle->vindices[1] == v)
+				triangle->nindices[1] = avg;
+			else if (triangle->vindices[2] == v)
+				triangle->nindices[2] = avg;
+		}
+		else {
+			model->normals[3 * normal + 0] = facet[0];
+			model->normals[3 * normal + 1] = facet[1];
+			model->normals[3 * normal + 2] = facet[2];
+			if (triangle->vindices[0] == v)
+				triangle->nindices[0] = normal;
+			else if (triangle->vindices[1] == v)
+				triangle->nindices[1] = normal;
+			else if (triangle->vindices[2] == v)
+				triangle->nindices[2] = normal;
+			normal++;
+		}
 	}
+
+	return numnormals;
 }
 
 /* glmVertexNormals: Generates smooth vertex normals for a model.
@@ -1015,14 +2156,13 @@ glmFacetNormals(GLMmodel* model)
 GLvoid
 glmVertexNormals(GLMmodel* model, GLfloat angle)
 {
-	GLMnode* node;
-	GLMnode* tail;
-	GLMnode** members;
-	GLfloat* normals;
+	GLuint* first;             /* start of the triangles of each vertex */
+	GLuint* members;           /* triangles of all vertices */
+	GLuint* normal;            /* first normal of each vertex */
 	GLuint numnormals;
-	GLfloat average[3];
-	GLfloat dot, cos_angle;
-	GLuint i, avg;
+	GLfloat cos_angle;
+	GLuint i, v;
+	int n, count;              /* signed for OpenMP */
 
 	assert(model);
 	assert(model->facetnorms);
@@ -1032,135 +2172,60 @@ glmVertexNormals(GLMmodel* model, GLfloat angle)
 
 	/* nuke any previous normals */
 	if (model->normals)
-		free(model->normals);
-
-	/* allocate space for new normals */
-	model->numnormals = model->numtriangles * 3; /* 3 normals per triangle */
-	model->normals = (GLfloat*)malloc(sizeof(GLfloat) * 3 * (model->numnormals + 1));
+		glmFree(model, model->normals);
 
-	/* allocate a structure that will hold a linked list of triangle
-	indices for each vertex */
-	members = (GLMnode**)malloc(sizeof(GLMnode*) * (model->numvertices + 1));
-	for (i = 1; i <= model->numvertices; i++)
-		members[i] = NULL;
-
-	/* for every triangle, create a node for each vertex in it */
+	/* count the triangles each vertex is in, the triangles of vertex
+	i are members[first[i]] up to members[first[i + 1]] */
+	first = (GLuint*)calloc(model->numvertices + 2, sizeof(GLuint));
 	for (i = 0; i < model->numtriangles; i++) {
-		node = (GLMnode*)malloc(sizeof(GLMnode));
-		node->index = i;
-		node->next = members[T(i).vindices[0]];
-		members[T(i).vindices[0]] = node;
-
-		node = (GLMnode*)malloc(sizeof(GLMnode));
-		node->index = i;
-		node->next = members[T(i).vindices[1]];
-		members[T(i).vindices[1]] = node;
+		first[T(i).vindices[0] + 1]++;
+		first[T(i).vindices[1] + 1]++;
+		first[T(i).vindices[2] + 1]++;
+	}
+	for (v = 1; v <= model->numvertices + 1; v++)
+		first[v] += first[v - 1];
 
-		node = (GLMnode*)malloc(sizeof(GLMnode));
-		node->index = i;
-		node->next = members[T(i).vindices[2]];
-		members[T(i).vindices[2]] = node;
+	/* list the triangles of each vertex, latest first */
+	normal = (GLuint*)malloc(sizeof(GLuint) * (model->numvertices + 2));
+	memcpy(normal, first, sizeof(GLuint) * (model->numvertices + 2));
+	members = (GLuint*)malloc(sizeof(GLuint) * 3 * (model->numtriangles + 1));
+	for (i = 0; i < model->numtriangles; i++) {
+		members[--normal[T(i).vindices[0] + 1]] = i;
+		members[--normal[T(i).vindices[1] + 1]] = i;
+		members[--normal[T(i).vindices[2] + 1]] = i;
 	}
 
-	/* calculate the average normal for each vertex */
+	/* count the normals each vertex needs */
+	count = (int)model->numvertices;
+#pragma omp parallel for schedule(dynamic, 1024)
+	for (n = 1; n <= count; n++)
+		normal[n] = glmSmoothVertex(model, n, &members[first[n]],
+		first[n + 1] - first[n], cos_angle, 0);
+
+	/* number the normals in vertex order */
 	numnormals = 1;
-	for (i = 1; i <= model->numvertices; i++) {
-		/* calculate an average normal for this vertex by averaging the
-		facet normal of every triangle this vertex is in */
-		node = members[i];
-		if (!node)
+	for (v = 1; v <= model->numvertices; v++) {
+		if (first[v] == first[v + 1])
 			fprintf(stderr, "glmVertexNormals(): vertex w/o a triangle\n");
-		average[0] = 0.0; average[1] = 0.0; average[2] = 0.0;
-		avg = 0;
-		while (node) {
-			/* only average if the dot product of the angle between the two
-			facet normals is greater than the cosine of the threshold
-			angle -- or, said another way, the angle between the two
-			facet normals is less than (or equal to) the threshold angle */
-			dot = glmDot(&model->facetnorms[3 * T(node->index).findex],
-				&model->facetnorms[3 * T(members[i]->index).findex]);
-			if (dot > cos_angle) {
-				node->averaged = GL_TRUE;
-				average[0] += model->facetnorms[3 * T(node->index).findex + 0];
-				average[1] += model->facetnorms[3 * T(node->index).findex + 1];
-				average[2] += model->facetnorms[3 * T(node->index).findex + 2];
-				avg = 1;            /* we averaged at least one normal! */
-			}
-			else {
-				node->averaged = GL_FALSE;
-			}
-			node = node->next;
-		}
-
-		if (avg) {
-			/* normalize the averaged normal */
-			glmNormalize(average);
-
-			/* add the normal to the vertex normals list */
-			model->normals[3 * numnormals + 0] = average[0];
-			model->normals[3 * numnormals + 1] = average[1];
-			model->normals[3 * numnormals + 2] = average[2];
-			avg = numnormals;
-			numnormals++;
-		}
-
-		/* set the normal of this vertex in each triangle it is in */
-		node = members[i];
-		while (node) {
-			if (node->averaged) {
-				/* if this node was averaged, use the average normal */
-				if (T(node->index).vindices[0] == i)
-					T(node->index).nindices[0] = avg;
-				else if (T(node->index).vindices[1] == i)
-					T(node->index).nindices[1] = avg;
-				else if (T(node->index).vindices[2] == i)
-					T(node->index).nindices[2] = avg;
-			}
-			else {
-				/* if this node wasn't averaged, use the facet normal */
-				model->normals[3 * numnormals + 0] =
-					model->facetnorms[3 * T(node->index).findex + 0];
-				model->normals[3 * numnormals + 1] =
-					model->facetnorms[3 * T(node->index).findex + 1];
-				model->normals[3 * numnormals + 2] =
-					model->facetnorms[3 * T(node->index).findex + 2];
-				if (T(node->index).vindices[0] == i)
-					T(node->index).nindices[0] = numnormals;
-				else if (T(node->index).vindices[1] == i)
-					T(node->index).nindices[1] = numnormals;
-				else if (T(node->index).vindices[2] == i)
-					T(node->index).nindices[2] = numnormals;
-				numnormals++;
-			}
-			node = node->next;
-		}
+		i = normal[v];
+		normal[v] = numnormals;
+		numnormals += i;
 	}
 
+	/* allocate space for the new normals */
 	model->numnormals = numnormals - 1;
+	model->normals = (GLfloat*)malloc(sizeof(GLfloat) * 3 * (model->numnormals + 1));
 
-	/* free the member information */
-	for (i = 1; i <= model->numvertices; i++) {
-		node = members[i];
-		while (node) {
-			tail = node;
-			node = node->next;
-			free(tail);
-		}
-	}
-	free(members);
+	/* calculate the normals, vertices only touch their own normals and
+	triangle corners */
+#pragma omp parallel for schedule(dynamic, 1024)
+	for (n = 1; n <= count; n++)
+		glmSmoothVertex(model, n, &members[first[n]],
+		first[n + 1] - first[n], cos_angle, normal[n]);
 
-	/* pack the normals array (we previously allocated the maximum
-	number of normals that could possibly be created (numtriangles *
-	3), so get rid of some of them (usually alot unless none of the
-	facet normals were averaged)) */
-	normals = model->normals;
-	model->normals = (GLfloat*)malloc(sizeof(GLfloat) * 3 * (model->numnormals + 1));
-	for (i = 1; i <= model->numnormals; i++) {
-		model->normals[3 * i + 0] = normals[3 * i + 0];
-		model->normals[3 * i + 1] = normals[3 * i + 1];
-		model->normals[3 * i + 2] = normals[3 * i + 2];
-	}
-	free(normals);
+	free(first);
+	free(members);
+	free(normal);
 }
 
 
@@ -1181,7 +2246,7 @@ glmLinearTexture(GLMmodel* model)
 	assert(model);
 
 	if (model->texcoords)
-		free(model->texcoords);
+		glmFree(model, model->texcoords);
 	model->numtexcoords = model->numvertices;
 	model->texcoords = (GLfloat*)malloc(sizeof(GLfloat) * 2 * (model->numtexcoords + 1));
 
@@ -1236,7 +2301,7 @@ glmSpheremapTexture(GLMmodel* model)
 	assert(model->normals);
 
 	if (model->texcoords)
-		free(model->texcoords);
+		glmFree(model, model->texcoords);
 	model->numtexcoords = model->numnormals;
 	model->texcoords = (GLfloat*)malloc(sizeof(GLfloat) * 2 * (model->numtexcoords + 1));
 
@@ -1293,23 +2358,27 @@ glmDelete(GLMmodel* model)
 
 	if (model->pathname)     free(model->pathname);
 	if (model->mtllibname) free(model->mtllibname);
-	if (model->vertices)     free(model->vertices);
-	if (model->normals)  free(model->normals);
-	if (model->texcoords)  free(model->texcoords);
-	if (model->facetnorms) free(model->facetnorms);
-	if (model->triangles)  free(model->triangles);
+	if (model->vertices)     glmFree(model, model->vertices);
+	if (model->normals)  glmFree(model, model->normals);
+	if (model->texcoords)  glmFree(model, model->texcoords);
+	if (model->facetnorms) glmFree(model, model->facetnorms);
+	if (model->triangles)  glmFree(model, model->triangles);
 	if (model->materials) {
 		for (i = 0; i < model->nummaterials; i++)
-			free(model->materials[i].name);
+			glmFree(model, model->materials[i].name);
 	}
 	free(model->materials);
 	while (model->groups) {
 		group = model->groups;
 		model->groups = model->groups->next;
-		free(group->name);
-		free(group->triangles);
+		glmFree(model, group->name);
+		glmFree(model, group->triangles);
 		free(group);
 	}
+	if (model->filemap) {
+		glmUnmapFile((GLMfilemap*)model->filemap);
+		free(model->filemap);
+	}
 
 	free(model);
 }
@@ -1324,11 +2393,26 @@ GLMmodel*
 glmReadOBJ(char* filename)
 {
 	GLMmodel* model;
-	FILE* file;
-
-	/* open the file */
-	file = fopen(filename, "r");
-	if (!file) {
+	GLMfilemap filemap;
+	char* binname;
+
+	/* use the binary model next to the file if it is newer than the
+	.obj and its .mtl, the .bin holds a copy of the materials */
+	binname = glmBinName(filename);
+	model = glmNewer(binname, filename) ? glmReadBIN(binname) : NULL;
+	if (model && !glmMaterialsCurrent(model, binname)) {
+		glmDelete(model);
+		model = NULL;
+	}
+	free(binname);
+	if (model) {
+		free(model->pathname);
+		model->pathname = strdup(filename);
+		return model;
+	}
+
+	/* map the file */
+	if (!glmMapFile(&filemap, filename)) {
 		fprintf(stderr, "glmReadOBJ() failed: can't open data file \"%s\".\n",
 			filename);
 		exit(1);
@@ -1355,32 +2439,108 @@ glmReadOBJ(char* filename)
 	model->position[0] = 0.0;
 	model->position[1] = 0.0;
 	model->position[2] = 0.0;
+	model->filemap = NULL;
 
-	/* make a first pass through the file to get a count of the number
-	of vertices, normals, texcoords & triangles */
-	glmFirstPass(model, file);
+	/* read in all the data in one pass through the mapped file */
+	glmParseOBJ(model, filemap.data, filemap.data + filemap.size);
 
-	/* allocate memory */
-	model->vertices = (GLfloat*)malloc(sizeof(GLfloat) *
-		3 * (model->numvertices + 1));
-	model->triangles = (GLMtriangle*)malloc(sizeof(GLMtriangle) *
-		model->numtriangles);
-	if (model->numnormals) {
-		model->normals = (GLfloat*)malloc(sizeof(GLfloat) *
-			3 * (model->numnormals + 1));
+	/* unmap the file */
+	glmUnmapFile(&filemap);
+
+	return model;
+}
+
+/* glmReadBIN: Maps a model written by glmWriteBIN.  Nothing is parsed
+* or copied, the arrays of the returned model point into the mapped
+* file (pages are copied on write).  Returns NULL if the file can't be
+* read or is not a valid binary model, indices out of their arrays
+* included.  The model should be free'd with glmDelete().
+*
+* filename - name of the binary model file
+*/
+GLMmodel*
+glmReadBIN(char* filename)
+{
+	GLMmodel* model;
+	GLMfilemap* filemap;
+	GLMbinheader* header;
+	GLMbingroup* groups;
+	GLMbinmaterial* materials;
+	GLMgroup* group;
+	GLMgroup** tail;
+	char* data;
+	char* strings;
+	GLuint i;
+
+	/* map the file */
+	filemap = (GLMfilemap*)malloc(sizeof(GLMfilemap));
+	if (!glmMapFile(filemap, filename)) {
+		free(filemap);
+		return NULL;
 	}
-	if (model->numtexcoords) {
-		model->texcoords = (GLfloat*)malloc(sizeof(GLfloat) *
-			2 * (model->numtexcoords + 1));
+	if (!glmCheckBIN(filemap)) {
+		fprintf(stderr, "glmReadBIN() failed: \"%s\" is not a valid binary model.\n",
+			filename);
+		glmUnmapFile(filemap);
+		free(filemap);
+		return NULL;
 	}
+	data = filemap->data;
+	header = (GLMbinheader*)data;
+	strings = data + header->strings;
 
-	/* rewind to beginning of file and read in the data this pass */
-	rewind(file);
-
-	glmSecondPass(model, file);
+	/* the arrays point into the file */
+	model = (GLMmodel*)malloc(sizeof(GLMmodel));
+	model->pathname = strdup(filename);
+	model->mtllibname = header->mtllibname != GLM_BIN_NONE ?
+		strdup(strings + header->mtllibname) : NULL;
+	model->numvertices = header->numvertices;
+	model->vertices = header->vertices ? (GLfloat*)(data + header->vertices) : NULL;
+	model->numnormals = header->numnormals;
+	model->normals = header->normals ? (GLfloat*)(data + header->normals) : NULL;
+	model->numtexcoords = header->numtexcoords;
+	model->texcoords = header->texcoords ? (GLfloat*)(data + header->texcoords) : NULL;
+	model->numfacetnorms = header->numfacetnorms;
+	model->facetnorms = header->facetnorms ? (GLfloat*)(data + header->facetnorms) : NULL;
+	model->numtriangles = header->numtriangles;
+	model->triangles = header->triangles ? (GLMtriangle*)(data + header->triangles) : NULL;
+	model->position[0] = header->position[0];
+	model->position[1] = header->position[1];
+	model->position[2] = header->position[2];
+	model->filemap = filemap;
+
+	/* materials and groups need their own structures, names and
+	triangle lists still point into the file */
+	model->nummaterials = header->nummaterials;
+	model->materials = NULL;
+	if (header->nummaterials) {
+		materials = (GLMbinmaterial*)(data + header->materials);
+		model->materials = (GLMmaterial*)malloc(sizeof(GLMmaterial) * header->nummaterials);
+		for (i = 0; i < header->nummaterials; i++) {
+			model->materials[i].name = strings + materials[i].name;
+			memcpy(model->materials[i].diffuse, materials[i].diffuse, sizeof(GLfloat) * 4);
+			memcpy(model->materials[i].ambient, materials[i].ambient, sizeof(GLfloat) * 4);
+			memcpy(model->materials[i].specular, materials[i].specular, sizeof(GLfloat) * 4);
+			memcpy(model->materials[i].emmissive, materials[i].emmissive, sizeof(GLfloat) * 4);
+			model->materials[i].shininess = materials[i].shininess;
+		}
+	}
 
-	/* close the file */
-	fclose(file);
+	model->numgroups = header->numgroups;
+	model->groups = NULL;
+	tail = &model->groups;
+	groups = (GLMbingroup*)(data + header->groups);
+	for (i = 0; i < header->numgroups; i++) {
+		group = (GLMgroup*)malloc(sizeof(GLMgroup));
+		group->name = strings + groups[i].name;
+		group->numtriangles = groups[i].numtriangles;
+		group->triangles = groups[i].numtriangles ?
+			(GLuint*)(data + header->grouptriangles) + groups[i].first : NULL;
+		group->material = groups[i].material;
+		group->next = NULL;
+		*tail = group;
+		tail = &group->next;
+	}
 
 	return model;
 }
@@ -1586,6 +2746,164 @@ glmWriteOBJ(GLMmodel* model, char* filename, GLuint mode)
 	fclose(file);
 }
 
+/* glmWriteBIN: Writes a model in the binary format read by glmReadBIN.
+* Everything in the model is written, including facet normals and
+* materials.  glmReadOBJ uses the binary file when it sits next to the
+* .obj file with a .bin extension and is newer than the .obj file and
+* its material library.
+*
+* model    - initialized GLMmodel structure
+* filename - name of the file to write the binary model to
+*/
+GLvoid
+glmWriteBIN(GLMmodel* model, char* filename)
+{
+	GLMbinheader header;
+	GLMbingroup* groups;
+	GLMbinmaterial* materials;
+	GLMgroup* group;
+	char* strings;
+	char* tmpname;
+	size_t offset, pos, len;
+	FILE* file;
+	GLuint i;
+
+	assert(model);
+
+	if (!glmLittleEndian()) {
+		fprintf(stderr, "glmWriteBIN() failed: big-endian hosts aren't supported.\n");
+		exit(1);
+	}
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, GLM_BIN_MAGIC, 4);
+	header.version = GLM_BIN_VERSION;
+	header.numvertices = model->numvertices;
+	header.numnormals = model->numnormals;
+	header.numtexcoords = model->numtexcoords;
+	header.numfacetnorms = model->numfacetnorms;
+	header.numtriangles = model->numtriangles;
+	header.nummaterials = model->nummaterials;
+	header.numgroups = model->numgroups;
+	header.position[0] = model->position[0];
+	header.position[1] = model->position[1];
+	header.position[2] = model->position[2];
+
+	/* collect the names into the string table */
+	len = model->mtllibname ? strlen(model->mtllibname) + 1 : 0;
+	for (i = 0; i < model->nummaterials; i++)
+		len += strlen(model->materials[i].name) + 1;
+	for (group = model->groups; group; group = group->next)
+		len += strlen(group->name) + 1;
+	strings = (char*)malloc(len ? len : 1);
+	len = 0;
+	header.mtllibname = GLM_BIN_NONE;
+	if (model->mtllibname) {
+		header.mtllibname = (GLuint)len;
+		strcpy(strings + len, model->mtllibname);
+		len += strlen(model->mtllibname) + 1;
+	}
+
+	materials = (GLMbinmaterial*)malloc(sizeof(GLMbinmaterial) * (model->nummaterials + 1));
+	for (i = 0; i < model->nummaterials; i++) {
+		materials[i].name = (GLuint)len;
+		strcpy(strings + len, model->materials[i].name);
+		len += strlen(model->materials[i].name) + 1;
+		memcpy(materials[i].diffuse, model->materials[i].diffuse, sizeof(GLfloat) * 4);
+		memcpy(materials[i].ambient, model->materials[i].ambient, sizeof(GLfloat) * 4);
+		memcpy(materials[i].specular, model->materials[i].specular, sizeof(GLfloat) * 4);
+		memcpy(materials[i].emmissive, model->materials[i].emmissive, sizeof(GLfloat) * 4);
+		materials[i].shininess = model->materials[i].shininess;
+	}
+
+	/* groups are written in list order, their triangle lists one after
+	another */
+	groups = (GLMbingroup*)malloc(sizeof(GLMbingroup) * (model->numgroups + 1));
+	for (group = model->groups, i = 0; group; group = group->next, i++) {
+		groups[i].name = (GLuint)len;
+		strcpy(strings + len, group->name);
+		len += strlen(group->name) + 1;
+		groups[i].numtriangles = group->numtriangles;
+		groups[i].first = header.numgrouptriangles;
+		groups[i].material = group->material;
+		header.numgrouptriangles += group->numtriangles;
+	}
+	header.stringsize = (GLuint)len;
+
+	/* lay out the sections */
+	offset = GLM_BIN_ALIGN(sizeof(header));
+#define GLM_SECTION(field, present, bytes) \
+	if (present) { header.field = (GLuint)offset; offset = GLM_BIN_ALIGN(offset + (bytes)); }
+	GLM_SECTION(vertices, model->vertices, sizeof(GLfloat) * 3 * ((size_t)model->numvertices + 1));
+	GLM_SECTION(normals, model->normals, sizeof(GLfloat) * 3 * ((size_t)model->numnormals + 1));
+	GLM_SECTION(texcoords, model->texcoords, sizeof(GLfloat) * 2 * ((size_t)model->numtexcoords + 1));
+	GLM_SECTION(facetnorms, model->facetnorms, sizeof(GLfloat) * 3 * ((size_t)model->numfacetnorms + 1));
+	GLM_SECTION(triangles, model->numtriangles, sizeof(GLMtriangle) * (size_t)model->numtriangles);
+	GLM_SECTION(grouptriangles, header.numgrouptriangles, sizeof(GLuint) * (size_t)header.numgrouptriangles);
+	GLM_SECTION(groups, model->numgroups, sizeof(GLMbingroup) * (size_t)model->numgroups);
+	GLM_SECTION(materials, model->nummaterials, sizeof(GLMbinmaterial) * (size_t)model->nummaterials);
+	GLM_SECTION(strings, len, len);
+#undef GLM_SECTION
+	if (offset > 0xffffffff) {
+		fprintf(stderr, "glmWriteBIN() failed: model too large for a binary file.\n");
+		exit(1);
+	}
+	header.size = (GLuint)offset;
+
+	/* write to a temporary file that replaces the file when complete,
+	readers never see a partial file and models mapped from the old
+	file stay valid */
+	tmpname = (char*)malloc(strlen(filename) + 5);
+	sprintf(tmpname, "%s.tmp", filename);
+	file = fopen(tmpname, "wb");
+	if (!file) {
+		fprintf(stderr, "glmWriteBIN() failed: can't open file \"%s\" to write.\n",
+			tmpname);
+		exit(1);
+	}
+
+	fwrite(&header, sizeof(header), 1, file);
+	pos = sizeof(header);
+	glmWriteSection(file, &pos, header.vertices, model->vertices,
+		sizeof(GLfloat) * 3 * (model->numvertices + 1));
+	glmWriteSection(file, &pos, header.normals, model->normals,
+		sizeof(GLfloat) * 3 * (model->numnormals + 1));
+	glmWriteSection(file, &pos, header.texcoords, model->texcoords,
+		sizeof(GLfloat) * 2 * (model->numtexcoords + 1));
+	glmWriteSection(file, &pos, header.facetnorms, model->facetnorms,
+		sizeof(GLfloat) * 3 * (model->numfacetnorms + 1));
+	glmWriteSection(file, &pos, header.triangles, model->triangles,
+		sizeof(GLMtriangle) * model->numtriangles);
+	glmWriteSection(file, &pos, header.grouptriangles, NULL, 0);
+	for (group = model->groups; group; group = group->next) {
+		if (group->numtriangles)
+			fwrite(group->triangles, sizeof(GLuint), group->numtriangles, file);
+		pos += sizeof(GLuint) * group->numtriangles;
+	}
+	glmWriteSection(file, &pos, header.groups, groups, sizeof(GLMbingroup) * model->numgroups);
+	glmWriteSection(file, &pos, header.materials, materials, sizeof(GLMbinmaterial) * model->nummaterials);
+	glmWriteSection(file, &pos, header.strings, strings, len);
+
+	glmWriteSection(file, &pos, header.size, NULL, 0);
+	if (fclose(file) != 0) {
+		fprintf(stderr, "glmWriteBIN() failed: can't write file \"%s\".\n", tmpname);
+		exit(1);
+	}
+
+#if defined(_WIN32) || defined(_MSC_VER)
+	remove(filename);           /* rename() doesn't replace files here */
+#endif
+	if (rename(tmpname, filename) != 0) {
+		fprintf(stderr, "glmWriteBIN() failed: can't replace file \"%s\".\n", filename);
+		exit(1);
+	}
+	free(tmpname);
+
+	free(strings);
+	free(materials);
+	free(groups);
+}
+
 /* glmDraw: Renders the model to the current OpenGL context using the
 * mode specified.
 *
@@ -1764,7 +3082,7 @@ glmWeld(GLMmodel* model, GLfloat epsilon)
 	}
 
 	/* free space for old vertices */
-	free(vectors);
+	glmFree(model, vectors);
 
 	/* allocate space for the new vertices */
 	model->numvertices = numvectors;
@@ -94,6 +94,8 @@ typedef struct _GLMmodel {
 
 	GLfloat position[3];          /* position of the model */
 
+	GLvoid* filemap;              /* binary file mapped by glmReadBIN */
+
 } GLMmodel;
 
 
@@ -115,6 +117,15 @@ glmUnitize(GLMmodel* model);
 GLvoid
 glmDimensions(GLMmodel* model, GLfloat* dimensions);
 
+/* glmBoundingBox: Calculates the axis aligned bounding box of a model.
+*
+* model - initialized GLMmodel structure
+* min   - array of 3 GLfloats, minimum x, y and z on return
+* max   - array of 3 GLfloats, maximum x, y and z on return
+*/
+GLvoid
+glmBoundingBox(GLMmodel* model, GLfloat* min, GLfloat* max);
+
 /* glmScale: Scales a model by a given amount.
 *
 * model - properly initialized GLMmodel structure
@@ -199,6 +210,17 @@ glmDelete(GLMmodel* model);
 GLMmodel*
 glmReadOBJ(char* filename);
 
+/* glmReadBIN: Maps a model written by glmWriteBIN.  Nothing is parsed
+* or copied, the arrays of the returned model point into the mapped
+* file (pages are copied on write).  Returns NULL if the file can't be
+* read or is not a valid binary model, indices out of their arrays
+* included.  The model should be free'd with glmDelete().
+*
+* filename - name of the binary model file
+*/
+GLMmodel*
+glmReadBIN(char* filename);
+
 /* glmWriteOBJ: Writes a model description in Wavefront .OBJ format to
 * a file.
 *
@@ -214,6 +236,18 @@ glmReadOBJ(char* filename);
 GLvoid
 glmWriteOBJ(GLMmodel* model, char* filename, GLuint mode);
 
+/* glmWriteBIN: Writes a model in the binary format read by glmReadBIN.
+* Everything in the model is written, including facet normals and
+* materials.  glmReadOBJ uses the binary file when it sits next to the
+* .obj file with a .bin extension and is newer than the .obj file and
+* its material library.
+*
+* model    - initialized GLMmodel structure
+* filename - name of the file to write the binary model to
+*/
+GLvoid
+glmWriteBIN(GLMmodel* model, char* filename);
+
 /* glmDraw: Renders the model to the current OpenGL context using the
 * mode specified.
 *
@@ -2,6 +2,7 @@
 #include "glm.h"
 #include "cvCamera.h"
 #include "markerDetector.h"
+#include "pipeline.h"
 #include "timer.h"
 
 int main(int argc, char **argv)
@@ -41,20 +42,22 @@ int main(int argc, char **argv)
 	GLRenderer renderer;
 	renderer.init(argc, argv, frameWidth, frameHeight, nearPlane, farPlane, cam, bmdl);
 
+	// capture and marker detection run on their own threads,
+	// each detected frame is rendered and shown here in capture order
+	ARPipeline pipeline(vc, markerDetector);
+	pipeline.start();
+
 	// process each frame
 	uchar key = 0;
-	cv::Mat frame, frameDrawing, depth32, depth8;
-	Timer t;
-	while (vc.read(frame))
+	PipelineFrame frame;
+	cv::Mat frameDrawing, rendered, depth32, depth8;
+	Timer t, fps;
+	fps.start();
+	while (pipeline.next(frame))
 	{
-		frameDrawing = frame.clone();
-		depth8 = cv::Mat::zeros(frame.size(), CV_8UC1);
-		t.start();
-		markerDetector.processFrame(frameDrawing);
-		t.stop();
-		printf("marker detection:%f\n", t.getElapsedTimeInMilliSec());
+		frameDrawing = frame.image;
 
-		const std::vector<cv::Mat> &markerTrans = markerDetector.getTransformations();
+		const std::vector<cv::Mat> &markerTrans = frame.transformations;
 		
 		t.start();
 		if (markerTrans.size()>0)
@@ -62,20 +65,31 @@ int main(int argc, char **argv)
 			renderer.camera.setExtrinsic(markerTrans[0]);
 			renderer.bgImg = frameDrawing;
 			renderer.bgImgUsed = true;
+			// the returned frame is drawn with exactly the pose set above,
+			// renderPipelined() would return the previous one with its own pose
 			renderer.render();
-			frameDrawing = renderer.bgrImg;
-			depth32 = renderer.depthMap;
+			renderer.getLatestFrame(rendered, depth32);
+			frameDrawing = rendered;
 			cv::normalize(depth32, depth8, 0, 255, cv::NORM_MINMAX, CV_8UC1);
 		}
+		else
+		{
+			// reuse the buffer of the last depth image
+			depth8.create(frameDrawing.size(), CV_8UC1);
+			depth8.setTo(cv::Scalar(0));
+		}
 		t.stop();
-		printf("rendering:%f\n", t.getElapsedTimeInMilliSec());
+		printf("frame %ld rendering:%f\n", frame.id, t.getElapsedTimeInMilliSec());
 
 		cv::imshow("Show Marker", frameDrawing);
 		cv::imshow("d", depth8);
 		key = cv::waitKey(1);
 		if (key == 27) break;
 	}
+	fps.stop();
+	printf("%ld frames, %f fps\n", frame.id + 1, (frame.id + 1) / fps.getElapsedTimeInSec());
 
+	pipeline.stop();
 	vc.release();
 	glmDelete(bmdl);
 	return 0;
@@ -1,22 +1,9 @@
+#include <cstring>
 #include "marker.h"
 
 Marker::Marker()
-	: m_id(-1), m_transformation(3, 4, CV_32FC1)
+	: m_id(-1)
 {
-	m_transformation.ptr<float>(0)[0] = 1.0f;
-	m_transformation.ptr<float>(0)[1] = 0.0f;
-	m_transformation.ptr<float>(0)[2] = 0.0f;
-	m_transformation.ptr<float>(0)[3] = 0.0f;
-
-	m_transformation.ptr<float>(1)[0] = 0.0f;
-	m_transformation.ptr<float>(1)[1] = 1.0f;
-	m_transformation.ptr<float>(1)[2] = 0.0f;
-	m_transformation.ptr<float>(1)[3] = 0.0f;
-
-	m_transformation.ptr<float>(2)[0] = 0.0f;
-	m_transformation.ptr<float>(2)[1] = 0.0f;
-	m_transformation.ptr<float>(2)[2] = 1.0f;
-	m_transformation.ptr<float>(2)[3] = 0.0f;
 }
 
 bool operator<(const Marker &M1, const Marker&M2)
@@ -25,77 +12,213 @@ bool operator<(const Marker &M1, const Marker&M2)
 }
 
 /*
-** rotate the matrix in clockwise by 90 degree
+** lookup tables of the packed 25-bit code, bit y * 5 + x is cell (x, y) of the inner 5x5
 */
-cv::Mat Marker::rotate(cv::Mat in)
+struct MarkerCodeTables
 {
-	cv::Mat out;
-	in.copyTo(out);
-	for (int i = 0; i < in.rows; i++)
+	// rows of the code, bit1 and bit3 carry the information
+	static const unsigned int words[4];
+
+	unsigned char rowWord[32];         // index of the word nearest to a 5-bit row
+	unsigned char rowDistance[32];     // its hamming distance, 5 when two words are as near
+	unsigned int rotation[4][256];     // clockwise rotation of each byte of the code
+
+	MarkerCodeTables()
 	{
-		for (int j = 0; j < in.cols; j++)
+		for (unsigned int row = 0; row < 32; row++)
+		{
+			int best = 0, bestDist = 6, ties = 0;
+			for (int p = 0; p < 4; p++)
+			{
+				int dist = 0;
+				for (int x = 0; x < 5; x++)
+					dist += ((row ^ words[p]) >> x) & 1;
+				if (dist < bestDist)
+				{
+					best = p;
+					bestDist = dist;
+					ties = 0;
+				}
+				else if (dist == bestDist)
+					ties++;
+			}
+			rowWord[row] = (unsigned char)best;
+			rowDistance[row] = (unsigned char)(ties ? 5 : bestDist);
+		}
+
+		// cell (x, y) goes to (4 - y, x)
+		for (int b = 0; b < 4; b++)
 		{
-			out.at<uchar>(i, j) = in.at<uchar>(in.cols - j - 1, i);
+			for (int v = 0; v < 256; v++)
+			{
+				unsigned int r = 0;
+				for (int t = 0; t < 8; t++)
+				{
+					int k = b * 8 + t;
+					if (k < 25 && ((v >> t) & 1))
+						r |= 1u << ((k % 5) * 5 + 4 - k / 5);
+				}
+				rotation[b][v] = r;
+			}
 		}
 	}
-	return out;
+};
+
+// bit x of a word is cell x of the row: 10000, 10111, 01001, 01110
+const unsigned int MarkerCodeTables::words[4] = { 0x01, 0x1d, 0x12, 0x0e };
+
+static const MarkerCodeTables codeTables;
+
+unsigned int Marker::rotateCode(unsigned int code)
+{
+	return codeTables.rotation[0][code & 0xff] | codeTables.rotation[1][(code >> 8) & 0xff] |
+		codeTables.rotation[2][(code >> 16) & 0xff] | codeTables.rotation[3][code >> 24];
 }
 
-/*
-** hamming distance to each possible words
-*/
-int Marker::hammDistMarker(cv::Mat bits)
+int Marker::decodeCode(unsigned int code, int maxCorrection, int &nRotations)
 {
+	int bestId = -1, bestDist = 26;
+	bool tie = false;
+	nRotations = 0;
 
-	//possible words, the order is not important
-	int ids[4][5] =
+	for (int r = 0; r < 4; r++)
 	{
-		{ 1, 0, 0, 0, 0 },
-		{ 1, 0, 1, 1, 1 },
-		{ 0, 1, 0, 0, 1 },
-		{ 0, 1, 1, 1, 0 }
-	};
+		if (r > 0)
+			code = rotateCode(code);
 
-	int dist = 0;
+		// nearest word of every row, its index is the 2 information bits of the row
+		int dist = 0, id = 0;
+		for (int y = 0; y < 5; y++)
+		{
+			unsigned int row = (code >> (y * 5)) & 0x1f;
+			dist += codeTables.rowDistance[row];
+			id = (id << 2) | codeTables.rowWord[row];
+		}
 
-	for (int y = 0; y < 5; y++)
-	{
-		int minSum = 1e5; //hamming distance to each possible word
+		if (dist < bestDist)
+		{
+			bestId = id;
+			bestDist = dist;
+			nRotations = r;
+			tie = false;
+		}
+		else if (dist == bestDist)
+			tie = true;
+
+		// an exact code is taken in the first rotation it appears
+		if (dist == 0)
+			break;
+	}
 
-		for (int p = 0; p < 4; p++)
+	// a corrected code must be nearer in one rotation than in every other
+	if (bestDist > maxCorrection || (tie && bestDist > 0))
+		return -1;
+	return bestId;
+}
+
+int Marker::decodeBits(const uchar bits[25], int &nRotations)
+{
+	unsigned int code = 0;
+	for (int i = 0; i < 25; i++)
+		if (bits[i])
+			code |= 1u << i;
+	return decodeCode(code, 0, nRotations);
+}
+
+int Marker::sampleMarkerId(const cv::Mat &grayscale, const std::vector<cv::Point2f> &corners,
+	int &nRotations, int maxCorrection)
+{
+	assert(grayscale.type() == CV_8UC1);
+	assert(corners.size() == 4);
+	nRotations = 0;
+
+	// homography of the unit square to the quad, (0,0) (1,0) (1,1) (0,1) go to corners 0..3
+	float x0 = corners[0].x, y0 = corners[0].y;
+	float x1 = corners[1].x, y1 = corners[1].y;
+	float x2 = corners[2].x, y2 = corners[2].y;
+	float x3 = corners[3].x, y3 = corners[3].y;
+	float sx = x0 - x1 + x2 - x3, sy = y0 - y1 + y2 - y3;
+	float dx1 = x1 - x2, dx2 = x3 - x2, dy1 = y1 - y2, dy2 = y3 - y2;
+	float den = dx1 * dy2 - dx2 * dy1;
+	if (den == 0)
+		return -1;
+	float g = (sx * dy2 - dx2 * sy) / den;
+	float h = (dx1 * sy - sx * dy1) / den;
+	float a = x1 - x0 + g * x1, b = x3 - x0 + h * x3;
+	float d = y1 - y0 + g * y1, e = y3 - y0 + h * y3;
+
+	// mean of 3x3 points inside each of the 7x7 cells, nearest pixel
+	int cells[49];
+	for (int cy = 0; cy < 7; cy++)
+	{
+		for (int cx = 0; cx < 7; cx++)
 		{
 			int sum = 0;
-			//now, count
-			for (int x = 0; x < 5; x++)
+			for (int j = 1; j <= 3; j++)
 			{
-				sum += bits.at<uchar>(y, x) == ids[p][x] ? 0 : 1;
+				float v = (cy + j * 0.25f) / 7;
+				for (int i = 1; i <= 3; i++)
+				{
+					float u = (cx + i * 0.25f) / 7;
+					float w = 1.0f / (g * u + h * v + 1);
+					int px = cvRound((a * u + b * v + x0) * w);
+					int py = cvRound((d * u + e * v + y0) * w);
+					px = std::min(std::max(px, 0), grayscale.cols - 1);
+					py = std::min(std::max(py, 0), grayscale.rows - 1);
+					sum += grayscale.ptr<uchar>(py)[px];
+				}
 			}
-
-			if (minSum > sum)
-				minSum = sum;
+			cells[cy * 7 + cx] = sum;
 		}
+	}
 
-		//do the and
-		dist += minSum;
+	// the border is black and every code row has a white cell, so the level of
+	// black is the border mean and the level of white the mean of the bright inner cells
+	int dark = 0, brightest = 0;
+	for (int y = 0; y < 7; y++)
+	{
+		for (int x = 0; x < 7; x++)
+		{
+			if (y == 0 || y == 6 || x == 0 || x == 6)
+				dark += cells[y * 7 + x];
+			else
+				brightest = std::max(brightest, cells[y * 7 + x]);
+		}
 	}
+	dark /= 24;
 
-	return dist;
-}
+	int bright = 0, nBright = 0;
+	for (int y = 1; y < 6; y++)
+	{
+		for (int x = 1; x < 6; x++)
+		{
+			if (2 * cells[y * 7 + x] > dark + brightest)
+			{
+				bright += cells[y * 7 + x];
+				nBright++;
+			}
+		}
+	}
+	// too little contrast for a printed marker, sums are of 9 samples
+	if (nBright == 0 || bright / nBright - dark < 9 * 20)
+		return -1;
+	int threshold = (dark + bright / nBright) / 2;
 
-int Marker::mat2id(const cv::Mat &bits)
-{
-	//bits:01234
-	//bit1 and bit3 are valid information bits
-	//bit0, bit2 and bit4 are parity bits
-	int val = 0;
-	for (int y = 0; y < 5; y++)
+	// check the border
+	for (int i = 0; i < 7; i++)
 	{
-		val <<= 1;
-		if (bits.at<uchar>(y, 1)) val |= 1;
-		val <<= 1;
-		if (bits.at<uchar>(y, 3)) val |= 1;
+		if (cells[i] > threshold || cells[42 + i] > threshold ||
+			cells[i * 7] > threshold || cells[i * 7 + 6] > threshold)
+			return -1;
 	}
-	return val;
+
+	unsigned int code = 0;
+	for (int y = 0; y < 5; y++)
+		for (int x = 0; x < 5; x++)
+			if (cells[(y + 1) * 7 + x + 1] > threshold)
+				code |= 1u << (y * 5 + x);
+
+	return decodeCode(code, maxCorrection, nRotations);
 }
 
 int Marker::getMarkerId(cv::Mat &markerImage, int &nRotations)
@@ -139,7 +262,7 @@ int Marker::getMarkerId(cv::Mat &markerImage, int &nRotations)
 		}
 	}
 
-	cv::Mat bitMatrix = cv::Mat::zeros(5, 5, CV_8UC1);
+	uchar bits[25] = { 0 };
 
 	//get information(for each inner square, determine if it is  black or white)  
 	for (int y = 0; y < 5; y++)
@@ -152,39 +275,12 @@ int Marker::getMarkerId(cv::Mat &markerImage, int &nRotations)
 
 			int nZ = cv::countNonZero(cell);
 			if (nZ>(cellSize*cellSize) / 2)
-				bitMatrix.at<uchar>(y, x) = 1;
+				bits[y * 5 + x] = 1;
 		}
 	}
 
 	//check all possible rotations
-	cv::Mat rotations[4];
-	int distances[4];
-
-	rotations[0] = bitMatrix;
-	distances[0] = hammDistMarker(rotations[0]);
-
-	std::pair<int, int> minDist(distances[0], 0);
-
-	for (int i = 1; i < 4; i++)
-	{
-		//get the hamming distance to the nearest possible word
-		rotations[i] = rotate(rotations[i - 1]);
-		distances[i] = hammDistMarker(rotations[i]);
-
-		if (distances[i] < minDist.first)
-		{
-			minDist.first = distances[i];
-			minDist.second = i;
-		}
-	}
-
-	nRotations = minDist.second;
-	if (minDist.first == 0)
-	{
-		return mat2id(rotations[minDist.second]);
-	}
-
-	return -1;
+	return decodeBits(bits, nRotations);
 }
 
 void Marker::drawContour(cv::Mat& image, cv::Scalar color) const
@@ -29,11 +29,28 @@ public:
 	friend bool operator<(const Marker &M1, const Marker&M2);
 	friend std::ostream & operator<<(std::ostream &str, const Marker &M);
 
-	static cv::Mat rotate(cv::Mat  in);
-	static int hammDistMarker(cv::Mat bits);
-	static int mat2id(const cv::Mat &bits);
 	static int getMarkerId(cv::Mat &in, int &nRotations);
 
+	// the inner 5x5 cells packed into 25 bits, bit y * 5 + x is cell (x, y), 1 for white
+	// code rotated clockwise by 90 degree, four byte lookups
+	static unsigned int rotateCode(unsigned int code);
+
+	// id of the code in the rotation nearest to a valid code, nRotations is that clockwise
+	// rotation. Up to maxCorrection wrong cells are corrected, rows equally near two words
+	// are not. -1 if no rotation is near enough or two are equally near.
+	// Each rotation costs five row lookups in a precomputed table.
+	static int decodeCode(unsigned int code, int maxCorrection, int &nRotations);
+
+	// decodeCode() of the 5x5 bits, row by row, without correction
+	static int decodeBits(const uchar bits[25], int &nRotations);
+
+	// reads the marker whose corners are given clockwise from the top-left straight from
+	// the grayscale image. A few points per cell are sampled through the homography of the
+	// quad and thresholded halfway between the black border and the white cells.
+	// No image is allocated, -1 if the quad is no marker.
+	static int sampleMarkerId(const cv::Mat &grayscale, const std::vector<cv::Point2f> &corners,
+		int &nRotations, int maxCorrection = 0);
+
 	/*
 	** Use case:
 	int mc[] = {1,0,0,0,0,
@@ -56,7 +73,8 @@ public:
 	// Id of  the marker
 	int m_id;
 
-	// Marker transformation with regards to the camera
+	// Marker transformation with regards to the camera, 3x4 CV_32FC1,
+	// empty until the detector has estimated the pose
 	cv::Mat m_transformation;
 
 	std::vector<cv::Point2f> m_points;
@@ -4,6 +4,11 @@
 #include "markerDetector.h"
 #include "marker.h"
 #include "cvCamera.h"
+#include "pixelOps.h"
+
+#if PIXELOPS_SSE2
+#include <emmintrin.h>
+#endif
 
 //#define SHOW_DEBUG_IMAGES
 
@@ -36,6 +41,12 @@ float perimeter(const std::vector<cv::Point2f> &a)
 
 MarkerDetector::MarkerDetector(const Camera &calibration, const cv::Size2f &markerRealSize)
 	: m_minContourLengthAllowed(100)
+	, m_thresholdMethod(THRESHOLD_GAUSSIAN)
+	, m_pyramidLevels(0)
+	, m_tracking(false)
+	, m_fullScanInterval(15)
+	, m_framesSinceFullScan(0)
+	, m_maxCorrection(0)
 	, markerSize(105, 105)
 {
 	camMatrix = calibration.getIntrinsic().clone();
@@ -104,32 +115,187 @@ const std::vector<cv::Mat>& MarkerDetector::getTransformations() const
 	return m_transformations;
 }
 
+void MarkerDetector::setThresholdMethod(ThresholdMethod method)
+{
+	m_thresholdMethod = method;
+}
+
+MarkerDetector::ThresholdMethod MarkerDetector::getThresholdMethod() const
+{
+	return m_thresholdMethod;
+}
+
+void MarkerDetector::setPyramidLevels(int levels)
+{
+	CV_Assert(levels >= 0);
+	m_pyramidLevels = levels;
+	m_pyramid.resize(levels);
+}
+
+int MarkerDetector::getPyramidLevels() const
+{
+	return m_pyramidLevels;
+}
+
+void MarkerDetector::setTracking(bool enabled, int fullScanInterval)
+{
+	CV_Assert(fullScanInterval > 0);
+	m_tracking = enabled;
+	m_fullScanInterval = fullScanInterval;
+	m_framesSinceFullScan = 0;
+	m_trackedIds.clear();
+	m_trackedCorners.clear();
+}
+
+bool MarkerDetector::isTracking() const
+{
+	return m_tracking;
+}
+
+void MarkerDetector::setMaxCorrection(int cells)
+{
+	CV_Assert(cells >= 0);
+	m_maxCorrection = cells;
+}
+
+int MarkerDetector::getMaxCorrection() const
+{
+	return m_maxCorrection;
+}
+
 
 bool MarkerDetector::findMarkers(const cv::Mat& frame, std::vector<Marker>& detectedMarkers)
 {
-	cv::Mat bgraMat = frame.clone();
+	// Convert the image to grayscale, the frame is only read
+	prepareImage(frame, m_grayscaleImage);
+
+	// Follow the markers of the last frame, scan the whole frame periodically or once one is lost
+	bool tracked = m_tracking && !m_trackedIds.empty() && m_framesSinceFullScan < m_fullScanInterval &&
+		trackMarkers(m_grayscaleImage, detectedMarkers);
+	if (tracked)
+	{
+		m_framesSinceFullScan++;
+	}
+	else
+	{
+		searchFrame(detectedMarkers);
 
-	// Convert the image to grayscale
-	prepareImage(bgraMat, m_grayscaleImage);
+		// Find is them are markers
+		recognizeMarkers(m_grayscaleImage, detectedMarkers);
+		m_framesSinceFullScan = 0;
+	}
+
+	// Calculate their poses
+	estimatePosition(detectedMarkers);
+
+	//sort by id
+	std::sort(detectedMarkers.begin(), detectedMarkers.end());
+
+	if (m_tracking)
+	{
+		m_trackedIds.resize(detectedMarkers.size());
+		m_trackedCorners.resize(detectedMarkers.size());
+		for (size_t i = 0; i < detectedMarkers.size(); i++)
+		{
+			m_trackedIds[i] = detectedMarkers[i].m_id;
+			m_trackedCorners[i] = detectedMarkers[i].m_points;
+		}
+	}
+
+	return true;
+}
+
+void MarkerDetector::searchFrame(std::vector<Marker>& detectedMarkers)
+{
+	// Search candidates on a downscaled image, pyrDown pixel (x, y) is centered on (2x, 2y)
+	const cv::Mat* searchImage = &m_grayscaleImage;
+	for (int level = 0; level < m_pyramidLevels; level++)
+	{
+		cv::pyrDown(*searchImage, m_pyramid[level]);
+		searchImage = &m_pyramid[level];
+	}
 
 	// Make it binary
-	performThreshold(m_grayscaleImage, m_thresholdImg);
+	performThreshold(*searchImage, m_thresholdImg);
 
 	// Detect contours
-	m_minContourLengthAllowed = m_grayscaleImage.cols / 5;
+	m_minContourLengthAllowed = searchImage->cols / 5;
 	findContours(m_thresholdImg, m_contours, m_minContourLengthAllowed);
 
 	// Find closed contours that can be approximated with 4 points
 	findCandidates(m_contours, detectedMarkers);
 
-	// Find is them are markers
-	recognizeMarkers(m_grayscaleImage, detectedMarkers);
+	// Back to full resolution coordinates, the corners are refined when the markers are recognized
+	if (m_pyramidLevels > 0)
+	{
+		float scale = (float)(1 << m_pyramidLevels);
+		for (size_t i = 0; i < detectedMarkers.size(); i++)
+			for (size_t c = 0; c < detectedMarkers[i].m_points.size(); c++)
+				detectedMarkers[i].m_points[c] *= scale;
+	}
+}
 
-	// Calculate their poses
-	estimatePosition(detectedMarkers);
+bool MarkerDetector::trackMarkers(const cv::Mat& grayscale, std::vector<Marker>& detectedMarkers)
+{
+	// The last refined corners are the last pose projected to the image, up to the
+	// solvePnP residual. The margin covers the motion between two frames.
+	cv::Rect frameRect(0, 0, grayscale.cols, grayscale.rows);
+	m_minContourLengthAllowed = grayscale.cols / 5;
 
-	//sort by id
-	std::sort(detectedMarkers.begin(), detectedMarkers.end());
+	std::vector<Marker> candidates, roiCandidates;
+	for (size_t i = 0; i < m_trackedCorners.size(); i++)
+	{
+		cv::Rect box = cv::boundingRect(m_trackedCorners[i]);
+		int margin = std::max(box.width, box.height) / 4 + 8;
+		cv::Rect roi(box.x - margin, box.y - margin, box.width + 2 * margin, box.height + 2 * margin);
+		roi &= frameRect;
+		if (roi.area() == 0)
+			return false;
+
+		performThreshold(grayscale(roi), m_thresholdImg);
+		findContours(m_thresholdImg, m_contours, m_minContourLengthAllowed);
+		findCandidates(m_contours, roiCandidates);
+
+		cv::Point2f offset((float)roi.x, (float)roi.y);
+		for (size_t j = 0; j < roiCandidates.size(); j++)
+		{
+			for (size_t c = 0; c < roiCandidates[j].m_points.size(); c++)
+				roiCandidates[j].m_points[c] += offset;
+			candidates.push_back(roiCandidates[j]);
+		}
+	}
+
+	recognizeMarkers(grayscale, candidates);
+
+	// Each tracked marker takes the candidate of its id closest to its last corners.
+	// Overlapping margins can find a marker twice, the copies are dropped this way.
+	detectedMarkers.clear();
+	for (size_t i = 0; i < m_trackedIds.size(); i++)
+	{
+		int best = -1;
+		float bestDist = std::numeric_limits<float>::max();
+		for (size_t j = 0; j < candidates.size(); j++)
+		{
+			if (candidates[j].m_id != m_trackedIds[i])
+				continue;
+
+			float distSquared = 0;
+			for (int c = 0; c < 4; c++)
+			{
+				cv::Point2f v = candidates[j].m_points[c] - m_trackedCorners[i][c];
+				distSquared += v.dot(v);
+			}
+			if (distSquared < bestDist)
+			{
+				bestDist = distSquared;
+				best = (int)j;
+			}
+		}
+
+		if (best < 0)
+			return false;
+		detectedMarkers.push_back(candidates[best]);
+	}
 
 	return true;
 }
@@ -144,6 +310,9 @@ void MarkerDetector::performThreshold(const cv::Mat& grayscale, cv::Mat& thresho
 {
 	//cv::threshold(grayscale, thresholdImg, 127, 255, cv::THRESH_BINARY_INV);
 
+	if (m_thresholdMethod == THRESHOLD_MEAN)
+		meanThreshold(grayscale, thresholdImg, 7, 7);
+	else
 	cv::adaptiveThreshold(grayscale,   // Input image
 		thresholdImg,// Result binary image
 		255,         // 
@@ -159,6 +328,162 @@ void MarkerDetector::performThreshold(const cv::Mat& grayscale, cv::Mat& thresho
 #endif
 }
 
+/**
+* Mean threshold of a band of rows. Column sums of the window are kept per row
+* and slid down the band, the window sum of a pixel adds blockSize column sums.
+* A pixel is set when round(sum / area) >= src + C, that is when
+* 2 * sum + area >= 2 * area * (src + C), so no division is needed.
+*/
+class MeanThresholdBody : public cv::ParallelLoopBody
+{
+public:
+	MeanThresholdBody(const cv::Mat& src, cv::Mat& dst, int blockSize, int C, int bandRows)
+		: m_src(src), m_dst(dst), m_radius(blockSize / 2), m_C(C), m_bandRows(bandRows)
+		, m_sse2(pixelOps::simdLevel() >= pixelOps::SIMD_SSE2)
+	{
+	}
+
+	void operator()(const cv::Range& bands) const
+	{
+		const int width = m_src.cols;
+		const int height = m_src.rows;
+		const int r = m_radius;
+		const int area = (2 * r + 1) * (2 * r + 1);
+
+		// column sums with r replicated columns on each side
+		cv::AutoBuffer<ushort> buffer(width + 2 * r);
+		ushort* colSum = buffer;
+		ushort* sums = colSum + r;
+
+		// 16-bit lanes hold every term when the right side can't exceed 65535
+		bool fits16 = m_C >= 0 && 2 * area * (255 + m_C) <= 65535;
+
+		for (int band = bands.start; band < bands.end; band++)
+		{
+			int y0 = band * m_bandRows;
+			int y1 = std::min(height, y0 + m_bandRows);
+
+			// window of the first row of the band, rows outside the image are replicated
+			for (int x = 0; x < width; x++)
+				sums[x] = 0;
+			for (int k = -r; k <= r; k++)
+				addRow(sums, m_src.ptr<uchar>(clampRow(y0 + k, height)), width, 1);
+
+			for (int y = y0; y < y1; y++)
+			{
+				if (y > y0)
+				{
+					addRow(sums, m_src.ptr<uchar>(clampRow(y + r, height)), width, 1);
+					addRow(sums, m_src.ptr<uchar>(clampRow(y - r - 1, height)), width, -1);
+				}
+				for (int k = 1; k <= r; k++)
+				{
+					sums[-k] = sums[0];
+					sums[width - 1 + k] = sums[width - 1];
+				}
+
+				const uchar* s = m_src.ptr<uchar>(y);
+				uchar* d = m_dst.ptr<uchar>(y);
+				int x = 0;
+#if PIXELOPS_SSE2
+				if (fits16 && m_sse2)
+					x = thresholdRowSSE2(colSum, s, d, width, area);
+#endif
+				for (; x < width; x++)
+				{
+					int sum = 0;
+					for (int k = 0; k <= 2 * r; k++)
+						sum += colSum[x + k];
+					d[x] = 2 * sum + area >= 2 * area * (s[x] + m_C) ? 255 : 0;
+				}
+			}
+		}
+	}
+
+private:
+	static int clampRow(int y, int height)
+	{
+		return y < 0 ? 0 : (y >= height ? height - 1 : y);
+	}
+
+	// add sign times a row of pixels to the column sums
+	void addRow(ushort* sums, const uchar* row, int width, int sign) const
+	{
+		int x = 0;
+#if PIXELOPS_SSE2
+		const __m128i zero = _mm_setzero_si128();
+		for (; m_sse2 && x + 16 <= width; x += 16)
+		{
+			__m128i p = _mm_loadu_si128((const __m128i*)(row + x));
+			__m128i lo = _mm_unpacklo_epi8(p, zero);
+			__m128i hi = _mm_unpackhi_epi8(p, zero);
+			__m128i s0 = _mm_loadu_si128((const __m128i*)(sums + x));
+			__m128i s1 = _mm_loadu_si128((const __m128i*)(sums + x + 8));
+			if (sign > 0)
+			{
+				s0 = _mm_add_epi16(s0, lo);
+				s1 = _mm_add_epi16(s1, hi);
+			}
+			else
+			{
+				s0 = _mm_sub_epi16(s0, lo);
+				s1 = _mm_sub_epi16(s1, hi);
+			}
+			_mm_storeu_si128((__m128i*)(sums + x), s0);
+			_mm_storeu_si128((__m128i*)(sums + x + 8), s1);
+		}
+#endif
+		for (; x < width; x++)
+			sums[x] = (ushort)(sums[x] + sign * row[x]);
+	}
+
+#if PIXELOPS_SSE2
+	// 8 pixels per step, returns the first pixel left for the plain loop
+	int thresholdRowSSE2(const ushort* colSum, const uchar* s, uchar* d, int width, int area) const
+	{
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i areaTerm = _mm_set1_epi16((short)area);
+		const __m128i twoArea = _mm_set1_epi16((short)(2 * area));
+		const __m128i cTerm = _mm_set1_epi16((short)m_C);
+		int x = 0;
+		for (; x + 8 <= width; x += 8)
+		{
+			__m128i sum = _mm_loadu_si128((const __m128i*)(colSum + x));
+			for (int k = 1; k <= 2 * m_radius; k++)
+				sum = _mm_add_epi16(sum, _mm_loadu_si128((const __m128i*)(colSum + x + k)));
+
+			__m128i left = _mm_add_epi16(_mm_add_epi16(sum, sum), areaTerm);
+			__m128i pixels = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(s + x)), zero);
+			__m128i right = _mm_mullo_epi16(_mm_add_epi16(pixels, cTerm), twoArea);
+
+			// unsigned left >= right, the saturated difference right - left is 0
+			__m128i set = _mm_cmpeq_epi16(_mm_subs_epu16(right, left), zero);
+			_mm_storel_epi64((__m128i*)(d + x), _mm_packs_epi16(set, set));
+		}
+		return x;
+	}
+#endif
+
+	const cv::Mat& m_src;
+	cv::Mat& m_dst;
+	int m_radius;
+	int m_C;
+	int m_bandRows;
+	bool m_sse2;         // pixelOps::simdLevel() allows the SSE2 loops
+};
+
+void MarkerDetector::meanThreshold(const cv::Mat& grayscale, cv::Mat& thresholdImg, int blockSize, int C)
+{
+	CV_Assert(grayscale.type() == CV_8UC1 && blockSize % 2 == 1 && blockSize > 1 &&
+		blockSize * blockSize * 255 <= 65535);
+	thresholdImg.create(grayscale.size(), CV_8UC1);
+
+	// bands of 64 rows, each one rebuilds the column sums of its first row
+	const int bandRows = 64;
+	int bands = (grayscale.rows + bandRows - 1) / bandRows;
+	cv::parallel_for_(cv::Range(0, bands), MeanThresholdBody(grayscale, thresholdImg, blockSize, C, bandRows));
+}
+
 void MarkerDetector::findContours(cv::Mat& thresholdImg, ContoursVector& contours, int minContourPointsAllowed)
 {
 	ContoursVector allContours;
@@ -308,14 +633,16 @@ void MarkerDetector::recognizeMarkers(const cv::Mat& grayscale, std::vector<Mark
 	{
 		Marker& marker = detectedMarkers[i];
 
-		// Find the perspective transformation that brings current marker to rectangular form
-		cv::Mat markerTransform = cv::getPerspectiveTransform(marker.m_points, m_markerCorners2d);
-
-		// Transform image to get a canonical marker image
-		cv::warpPerspective(grayscale, canonicalMarkerImage, markerTransform, markerSize);
+		// Sample the cells through the perspective transformation of the marker, no warped image
+		int nRotations;
+		int id = Marker::sampleMarkerId(grayscale, marker.m_points, nRotations, m_maxCorrection);
 
 #ifdef SHOW_DEBUG_IMAGES
 		{
+			// Transform image to get a canonical marker image
+			cv::Mat markerTransform = cv::getPerspectiveTransform(marker.m_points, m_markerCorners2d);
+			cv::warpPerspective(grayscale, canonicalMarkerImage, markerTransform, markerSize);
+
 			cv::Mat markerImage = grayscale.clone();
 			marker.drawContour(markerImage);
 			cv::Mat markerSubImage = markerImage(cv::boundingRect(marker.points));
@@ -325,8 +652,6 @@ void MarkerDetector::recognizeMarkers(const cv::Mat& grayscale, std::vector<Mark
 		}
 #endif
 
-		int nRotations;
-		int id = Marker::getMarkerId(canonicalMarkerImage, nRotations);
 		if (id != -1)
 		{
 			marker.m_id = id;
@@ -353,8 +678,10 @@ void MarkerDetector::recognizeMarkers(const cv::Mat& grayscale, std::vector<Mark
 			}
 		}
 
+		// corners found on a pyramid level can be off by a few full resolution pixels, widen the search
+		int winSize = 4 + (1 << m_pyramidLevels);
 		cv::TermCriteria termCriteria = cv::TermCriteria(cv::TermCriteria::MAX_ITER | cv::TermCriteria::EPS, 30, 0.01);
-		cv::cornerSubPix(grayscale, preciseCorners, cvSize(5, 5), cvSize(-1, -1), termCriteria);
+		cv::cornerSubPix(grayscale, preciseCorners, cvSize(winSize, winSize), cvSize(-1, -1), termCriteria);
 
 		// Copy refined corners position back to markers
 		for (size_t i = 0; i < goodMarkers.size(); i++)
@@ -402,7 +729,8 @@ void MarkerDetector::estimatePosition(std::vector<Marker>& detectedMarkers)
 		cv::Mat_<float> rotMat(3, 3);
 		cv::Rodrigues(Rvec, rotMat);
 
-		// copy to transformation matrix
+		// copy to transformation matrix, a recycled one once the caller released it
+		m.m_transformation = m_transformationPool.acquire(cv::Size(4, 3), CV_32FC1);
 		for (int row = 0; row < 3; row++)
 		{
 			float *trptr = m.m_transformation.ptr<float>(row);
@@ -5,6 +5,7 @@
 // Standard includes:
 #include <vector>
 #include <opencv2/opencv.hpp>
+#include "framePool.h"
 
 ////////////////////////////////////////////////////////////////////
 // Forward declaration:
@@ -21,6 +22,13 @@ public:
 	typedef std::vector<cv::Point>    PointsVector;
 	typedef std::vector<PointsVector> ContoursVector;
 
+	//! Local threshold used to binarize the grayscale frame
+	enum ThresholdMethod
+	{
+		THRESHOLD_GAUSSIAN,   //!< cv::adaptiveThreshold with a Gaussian weighted window
+		THRESHOLD_MEAN        //!< mean of a square window, separable box filter on all cores
+	};
+
 	/**
 	* Initialize a new instance of marker detector object
 	* @calibration[in] - Camera calibration (intrinsic and distortion components) necessary for pose estimation.
@@ -32,11 +40,52 @@ public:
 
 	const std::vector<cv::Mat>& getTransformations() const;
 
+	//! Selects the threshold of the binarization step, THRESHOLD_GAUSSIAN by default
+	void setThresholdMethod(ThresholdMethod method);
+	ThresholdMethod getThresholdMethod() const;
+
+	/**
+	* Same result as cv::adaptiveThreshold with ADAPTIVE_THRESH_MEAN_C, THRESH_BINARY_INV
+	* and maxValue 255: pixels at least C below the mean of their blockSize x blockSize
+	* window become 255, the others 0. Borders are replicated.
+	* Bands of rows are filtered in parallel with cv::parallel_for_.
+	*/
+	static void meanThreshold(const cv::Mat& grayscale, cv::Mat& thresholdImg, int blockSize, int C);
+
+	/**
+	* Candidates are searched on the image halved levels times with cv::pyrDown, 0 by default.
+	* Their corners are scaled back and refined on the full resolution image, where the
+	* markers are also recognized. Thresholding and contour tracing get about 4^levels cheaper,
+	* markers must still be larger than a fifth of the downscaled width.
+	*/
+	void setPyramidLevels(int levels);
+	int getPyramidLevels() const;
+
+	/**
+	* In tracking mode the markers of the last frame are searched only in a margin around
+	* their last corners. The whole frame is scanned again every fullScanInterval frames,
+	* which is how new markers are found, and as soon as a tracked marker is lost.
+	* Off by default.
+	*/
+	void setTracking(bool enabled, int fullScanInterval = 15);
+	bool isTracking() const;
+
+	//! Wrong code cells corrected when a marker is recognized, 0 (exact codes only) by default.
+	//! Rotations of the codes are only 1 cell apart in places, more than 1 misreads often.
+	void setMaxCorrection(int cells);
+	int getMaxCorrection() const;
+
 protected:
 
 	//! Main marker detection routine
 	bool findMarkers(const cv::Mat& frame, std::vector<Marker>& detectedMarkers);
 
+	//! Finds marker candidates in the whole frame, on the pyramid level if one is set
+	void searchFrame(std::vector<Marker>& detectedMarkers);
+
+	//! Finds the markers of the last frame near their last corners, false if one is lost
+	bool trackMarkers(const cv::Mat& grayscale, std::vector<Marker>& detectedMarkers);
+
 	//! Converts image to grayscale
 	void prepareImage(const cv::Mat& bgraMat, cv::Mat& grayscale);
 
@@ -57,17 +106,27 @@ protected:
 
 private:
 	float m_minContourLengthAllowed;
+	ThresholdMethod m_thresholdMethod;
+	int m_pyramidLevels;
+	bool m_tracking;
+	int m_fullScanInterval;
+	int m_framesSinceFullScan;
+	int m_maxCorrection;
 
 	cv::Size markerSize;
 	cv::Mat camMatrix;
 	cv::Mat distCoeff;
 	std::vector<cv::Mat> m_transformations;
+	FramePool m_transformationPool;   // recycled 3x4 poses handed out by getTransformations()
 
 	cv::Mat m_grayscaleImage;
+	std::vector<cv::Mat> m_pyramid;   // downscaled grayscale, one image per pyramid level
 	cv::Mat m_thresholdImg;
 	cv::Mat canonicalMarkerImage;
 
 	ContoursVector           m_contours;
+	std::vector<int>         m_trackedIds;       // markers found in the last frame
+	std::vector<std::vector<cv::Point2f> > m_trackedCorners;
 	std::vector<cv::Point3f> m_markerCorners3d;
 	std::vector<cv::Point2f> m_markerCorners2d;
 };
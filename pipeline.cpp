@@ -0,0 +1,173 @@
+#include "pipeline.h"
+#include "markerDetector.h"
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+ARPipeline::ARPipeline(cv::VideoCapture &cap, MarkerDetector &det, int queueSize)
+	: started(false)
+	, capture(cap)
+	, detector(det)
+	, captured(queueSize)
+	, detected(queueSize)
+	, running(0)
+	, captureDone(0)
+	, detectDone(0)
+{
+}
+
+ARPipeline::~ARPipeline()
+{
+	stop();
+}
+
+void ARPipeline::start()
+{
+	if (started)
+		return;
+
+	running = 1;
+	captureDone = detectDone = 0;
+#ifdef _WIN32
+	threads[0] = CreateThread(NULL, 0, captureEntry, this, 0, NULL);
+	threads[1] = CreateThread(NULL, 0, detectEntry, this, 0, NULL);
+#else
+	pthread_create(&threads[0], NULL, captureEntry, this);
+	pthread_create(&threads[1], NULL, detectEntry, this);
+#endif
+	started = true;
+}
+
+// ask both threads to finish and wait for them, frames still queued are dropped
+void ARPipeline::stop()
+{
+	if (!started)
+		return;
+
+	CV_XADD(&running, -1);
+#ifdef _WIN32
+	WaitForMultipleObjects(2, threads, TRUE, INFINITE);
+	CloseHandle(threads[0]);
+	CloseHandle(threads[1]);
+#else
+	pthread_join(threads[0], NULL);
+	pthread_join(threads[1], NULL);
+#endif
+	started = false;
+
+	PipelineFrame frame;
+	while (captured.pop(frame)) {}
+	while (detected.pop(frame)) {}
+}
+
+bool ARPipeline::next(PipelineFrame &frame)
+{
+	while (isRunning())
+	{
+		// check the done flag before popping, a frame pushed just before it was set is still seen
+		bool done = CV_XADD(&detectDone, 0) != 0;
+		if (detected.pop(frame))
+			return true;
+		if (done)
+			return false;
+		waitBriefly();
+	}
+	return false;
+}
+
+bool ARPipeline::isRunning()
+{
+	return CV_XADD(&running, 0) > 0;
+}
+
+// the stages poll their queues, sleep a little instead of spinning on a core
+void ARPipeline::waitBriefly()
+{
+#ifdef _WIN32
+	Sleep(1);
+#else
+	usleep(1000);
+#endif
+}
+
+void ARPipeline::captureLoop()
+{
+	long id = 0;
+	cv::Size size;
+	int type = CV_8UC3;
+	while (isRunning())
+	{
+		// the capture writes into a recycled buffer of the last frame's size,
+		// it only allocates for the first frame and when the size changes
+		PipelineFrame frame;
+		if (size.area() > 0)
+			frame.image = framePool.acquire(size, type);
+		if (!capture.read(frame.image) || frame.image.empty())
+			break;
+		size = frame.image.size();
+		type = frame.image.type();
+		frame.id = id++;
+
+		while (!captured.push(frame))
+		{
+			if (!isRunning())
+				break;
+			waitBriefly();
+		}
+	}
+	CV_XADD(&captureDone, 1);
+}
+
+void ARPipeline::detectLoop()
+{
+	while (isRunning())
+	{
+		bool done = CV_XADD(&captureDone, 0) != 0;
+		PipelineFrame frame;
+		if (!captured.pop(frame))
+		{
+			if (done)
+				break;
+			waitBriefly();
+			continue;
+		}
+
+		detector.processFrame(frame.image);
+		frame.transformations = detector.getTransformations();
+
+		while (!detected.push(frame))
+		{
+			if (!isRunning())
+				break;
+			waitBriefly();
+		}
+	}
+	CV_XADD(&detectDone, 1);
+}
+
+#ifdef _WIN32
+DWORD WINAPI ARPipeline::captureEntry(LPVOID self)
+{
+	((ARPipeline*)self)->captureLoop();
+	return 0;
+}
+
+DWORD WINAPI ARPipeline::detectEntry(LPVOID self)
+{
+	((ARPipeline*)self)->detectLoop();
+	return 0;
+}
+#else
+void* ARPipeline::captureEntry(void *self)
+{
+	((ARPipeline*)self)->captureLoop();
+	return NULL;
+}
+
+void* ARPipeline::detectEntry(void *self)
+{
+	((ARPipeline*)self)->detectLoop();
+	return NULL;
+}
+#endif
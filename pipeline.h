@@ -0,0 +1,116 @@
+#ifndef _PIPELINE_H_
+#define _PIPELINE_H_
+
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "framePool.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+class MarkerDetector;
+
+// bounded queue between exactly one producer thread and one consumer thread.
+// tail is only advanced by the producer and head only by the consumer, both with
+// CV_XADD, whose full barrier also publishes the slot written before it. No lock is taken.
+template <typename T>
+class SpscQueue
+{
+public:
+	explicit SpscQueue(int capacity) : slots(capacity), head(0), tail(0) {}
+
+	// producer side, false if the queue is full
+	bool push(const T &item)
+	{
+		unsigned int h = (unsigned int)CV_XADD(&head, 0);
+		if ((unsigned int)tail - h >= slots.size())
+			return false;
+		slots[(unsigned int)tail % slots.size()] = item;
+		CV_XADD(&tail, 1);
+		return true;
+	}
+
+	// consumer side, false if the queue is empty
+	bool pop(T &item)
+	{
+		unsigned int t = (unsigned int)CV_XADD(&tail, 0);
+		if (t == (unsigned int)head)
+			return false;
+		T &slot = slots[(unsigned int)head % slots.size()];
+		item = slot;
+		slot = T(); // don't keep the item alive until the slot is reused
+		CV_XADD(&head, 1);
+		return true;
+	}
+
+private:
+	std::vector<T> slots;
+	int head;                          // items popped so far, wraps around
+	int tail;                          // items pushed so far, wraps around
+};
+
+// a captured frame on its way through the pipeline
+struct PipelineFrame
+{
+	PipelineFrame() : id(-1) {}
+
+	long id;                               // capture order, starting at 0
+	cv::Mat image;                         // the captured image, a buffer of the pipeline's pool
+	std::vector<cv::Mat> transformations;  // marker poses found by the detector
+};
+
+// runs camera capture and marker detection on their own threads, connected to each
+// other and to the caller by bounded queues, so a frame is detected while the next
+// one is captured and the previous one is rendered on the calling thread.
+// The render stage stays on the caller because GLUT windows and cv::imshow()
+// can't move between threads. Frames come out in capture order.
+// A full queue stalls the stage feeding it, so the pipeline runs at the rate of its
+// slowest stage and holds at most queueSize frames between two stages.
+class ARPipeline
+{
+public:
+	ARPipeline(cv::VideoCapture &capture, MarkerDetector &detector, int queueSize = 2);
+	~ARPipeline();
+
+	void start();
+	void stop();
+
+	// wait for the next detected frame, false once capture has ended and
+	// every frame was handed out, or the pipeline was stopped
+	bool next(PipelineFrame &frame);
+
+private:
+	void captureLoop();
+	void detectLoop();
+	bool isRunning();
+	static void waitBriefly();
+
+#ifdef _WIN32
+	static DWORD WINAPI captureEntry(LPVOID self);
+	static DWORD WINAPI detectEntry(LPVOID self);
+	HANDLE threads[2];
+#else
+	static void* captureEntry(void *self);
+	static void* detectEntry(void *self);
+	pthread_t threads[2];
+#endif
+	bool started;
+
+	cv::VideoCapture &capture;
+	MarkerDetector &detector;
+	FramePool framePool;                   // captured images, used by the capture thread only
+	SpscQueue<PipelineFrame> captured;     // capture -> detection
+	SpscQueue<PipelineFrame> detected;     // detection -> caller
+	int running;                           // cleared by stop(), read with CV_XADD
+	int captureDone;                       // set once the capture thread pushed its last frame
+	int detectDone;                        // set once the detection thread pushed its last frame
+
+	// threads can't be copied
+	ARPipeline(const ARPipeline&);
+	ARPipeline& operator=(const ARPipeline&);
+};
+
+#endif
@@ -0,0 +1,331 @@
+#include "pixelOps.h"
+
+#if PIXELOPS_SSE2
+#include <immintrin.h>
+#endif
+#if PIXELOPS_TARGETS && defined(_MSC_VER)
+#include <intrin.h>
+#elif PIXELOPS_TARGETS
+#include <cpuid.h>
+#endif
+
+namespace pixelOps
+{
+
+static int simdLimit = SIMD_AVX2;
+
+#if PIXELOPS_TARGETS && !defined(_MSC_VER)
+// __builtin_cpu_supports() has no "f16c" before gcc 11, read cpuid leaf 1 directly
+static bool cpuHasF16C()
+{
+	unsigned int eax, ebx, ecx, edx;
+	return __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & bit_F16C);
+}
+#endif
+
+int simdLevel()
+{
+	static int level = -1;
+
+	if (level < 0)
+	{
+		int found = SIMD_NONE;
+#if PIXELOPS_SSE2
+		found = SIMD_SSE2;
+#if PIXELOPS_TARGETS && defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 0);
+		int maxLeaf = info[0];
+		if (maxLeaf >= 1)
+		{
+			__cpuid(info, 1);
+			if (info[2] & (1 << 9))
+				found = SIMD_SSSE3;
+
+			// avx needs the os to save the ymm registers too
+			if (found == SIMD_SSSE3 && (info[2] & (1 << 27)) && (info[2] & (1 << 28)) &&
+				(info[2] & (1 << 29)) && (_xgetbv(0) & 6) == 6)
+				found = SIMD_F16C;
+			if (found == SIMD_F16C && maxLeaf >= 7)
+			{
+				__cpuidex(info, 7, 0);
+				if (info[1] & (1 << 5))
+					found = SIMD_AVX2;
+			}
+		}
+#elif PIXELOPS_TARGETS
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("ssse3"))
+		{
+			found = SIMD_SSSE3;
+			if (__builtin_cpu_supports("avx") && cpuHasF16C())
+			{
+				found = SIMD_F16C;
+				if (__builtin_cpu_supports("avx2"))
+					found = SIMD_AVX2;
+			}
+		}
+#endif
+#endif
+		level = found;
+	}
+
+	return std::min(level, simdLimit);
+}
+
+void setSimdLimit(int level)
+{
+	simdLimit = level;
+}
+
+int depthType(DepthFormat format)
+{
+	return (format == DEPTH_WINDOW || format == DEPTH_FLOAT) ? CV_32FC1 : CV_16UC1;
+}
+
+unsigned short floatToHalf(float f)
+{
+	unsigned int bits;
+	memcpy(&bits, &f, sizeof(bits));
+
+	unsigned int sign = (bits >> 16) & 0x8000;
+	unsigned int absBits = bits & 0x7fffffff;
+	if (absBits >= 0x47800000) // overflow, inf and nan
+		return (unsigned short)(sign | (absBits > 0x7f800000 ? 0x7e00 : 0x7c00));
+	if (absBits < 0x38800000) // subnormal or zero, round by adding a magic float
+	{
+		float magic = 0.5f;
+		float value;
+		memcpy(&value, &absBits, sizeof(value));
+		value += magic;
+		unsigned int valueBits;
+		memcpy(&valueBits, &value, sizeof(valueBits));
+		return (unsigned short)(sign | (valueBits - 0x3f000000));
+	}
+
+	// normal, rebias the exponent and round the mantissa to nearest even
+	unsigned int half = (absBits - 0x38000000 + 0x0fff + ((absBits >> 13) & 1)) >> 13;
+	return (unsigned short)(sign | half);
+}
+
+static void rgbaToBgrRowC(const unsigned char *src, unsigned char *dst, int width)
+{
+	for (int j = 0; j < width; ++j)
+	{
+		dst[3 * j] = src[4 * j + 2];
+		dst[3 * j + 1] = src[4 * j + 1];
+		dst[3 * j + 2] = src[4 * j];
+	}
+}
+
+#if PIXELOPS_TARGETS
+// 4 pixels per shuffle, each 16-byte store writes 4 bytes past the 12 it fills,
+// so the loop stops while those bytes are still inside the row
+PIXELOPS_TARGET("ssse3") static void rgbaToBgrRowSSSE3(const unsigned char *src, unsigned char *dst, int width)
+{
+	const __m128i mask = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+	int j = 0;
+	for (; j + 6 <= width; j += 4)
+	{
+		__m128i rgba = _mm_loadu_si128((const __m128i*)(src + 4 * j));
+		_mm_storeu_si128((__m128i*)(dst + 3 * j), _mm_shuffle_epi8(rgba, mask));
+	}
+	rgbaToBgrRowC(src + 4 * j, dst + 3 * j, width - j);
+}
+#endif
+
+void rgbaToBgr(const unsigned char *src, int width, int height, cv::Mat &dst)
+{
+	CV_Assert(dst.type() == CV_8UC3 && dst.rows >= height && dst.cols >= width);
+
+	void (*row)(const unsigned char*, unsigned char*, int) = rgbaToBgrRowC;
+#if PIXELOPS_TARGETS
+	if (simdLevel() >= SIMD_SSSE3)
+		row = rgbaToBgrRowSSSE3;
+#endif
+
+	for (int i = 0; i < height; ++i)
+		row(src + (size_t)i*width * 4, dst.ptr<unsigned char>(height - i - 1), width);
+}
+
+// x / 255 rounded, exact for x <= 255 * 255
+static inline int div255(int x)
+{
+	x += 128;
+	return (x + (x >> 8)) >> 8;
+}
+
+static void blendRgbaRowC(const unsigned char *src, unsigned char *dst, int width)
+{
+	for (int j = 0; j < width; ++j)
+	{
+		int a = src[4 * j + 3];
+		if (a == 0)
+			continue;
+		dst[3 * j] = (unsigned char)div255(src[4 * j + 2] * a + dst[3 * j] * (255 - a));
+		dst[3 * j + 1] = (unsigned char)div255(src[4 * j + 1] * a + dst[3 * j + 1] * (255 - a));
+		dst[3 * j + 2] = (unsigned char)div255(src[4 * j] * a + dst[3 * j + 2] * (255 - a));
+	}
+}
+
+#if PIXELOPS_TARGETS
+// blend two pixels held as 16-bit BGRA lanes, d holds the destination as BGRx
+PIXELOPS_TARGET("ssse3") static inline __m128i blendPixels2(__m128i s, __m128i d)
+{
+	const __m128i max = _mm_set1_epi16(255);
+	const __m128i half = _mm_set1_epi16(128);
+	__m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+	__m128i x = _mm_add_epi16(_mm_mullo_epi16(s, a), _mm_mullo_epi16(d, _mm_sub_epi16(max, a)));
+	x = _mm_add_epi16(x, half);
+	return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+}
+
+// 4 pixels per step, the destination is widened to BGRx, blended in 16 bits
+// and narrowed back. Each 16-byte store puts back the 4 bytes past the 12 it fills,
+// so the loop stops while those bytes are still inside the row.
+PIXELOPS_TARGET("ssse3") static void blendRgbaRowSSSE3(const unsigned char *src, unsigned char *dst, int width)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i toBgra = _mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+	const __m128i widen = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+	const __m128i narrow = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+	const __m128i tail = _mm_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, -1, -1, -1, -1);
+	int j = 0;
+	for (; j + 6 <= width; j += 4)
+	{
+		__m128i rgba = _mm_loadu_si128((const __m128i*)(src + 4 * j));
+
+		// skip 4 transparent pixels, most of the model's bounding box around its outline
+		if ((_mm_movemask_epi8(_mm_cmpeq_epi8(rgba, zero)) & 0x8888) == 0x8888)
+			continue;
+
+		__m128i bgr = _mm_loadu_si128((const __m128i*)(dst + 3 * j));
+		__m128i s = _mm_shuffle_epi8(rgba, toBgra);
+		__m128i d = _mm_shuffle_epi8(bgr, widen);
+		__m128i lo = blendPixels2(_mm_unpacklo_epi8(s, zero), _mm_unpacklo_epi8(d, zero));
+		__m128i hi = blendPixels2(_mm_unpackhi_epi8(s, zero), _mm_unpackhi_epi8(d, zero));
+		__m128i out = _mm_shuffle_epi8(_mm_packus_epi16(lo, hi), narrow);
+		_mm_storeu_si128((__m128i*)(dst + 3 * j), _mm_or_si128(out, _mm_and_si128(bgr, tail)));
+	}
+	blendRgbaRowC(src + 4 * j, dst + 3 * j, width - j);
+}
+#endif
+
+void blendRgba(const unsigned char *src, int width, int height, cv::Mat &dst)
+{
+	CV_Assert(dst.type() == CV_8UC3 && dst.rows >= height && dst.cols >= width);
+
+	void (*row)(const unsigned char*, unsigned char*, int) = blendRgbaRowC;
+#if PIXELOPS_TARGETS
+	if (simdLevel() >= SIMD_SSSE3)
+		row = blendRgbaRowSSSE3;
+#endif
+
+	for (int i = 0; i < height; ++i)
+		row(src + (size_t)i*width * 4, dst.ptr<unsigned char>(height - i - 1), width);
+}
+
+#if PIXELOPS_TARGETS
+// 8 pixels of a DEPTH_HALF row per step, rounded to nearest even like floatToHalf().
+// Returns the first pixel left for the plain loop.
+PIXELOPS_TARGET("avx,f16c") static int encodeHalfRowF16C(const float *s, unsigned short *d, int width,
+	float a, float b, float farP)
+{
+	const __m256 va = _mm256_set1_ps(a), vb = _mm256_set1_ps(b), vf = _mm256_set1_ps(farP), one = _mm256_set1_ps(1.0f);
+	int j = 0;
+	for (; j + 8 <= width; j += 8)
+	{
+		__m256 w = _mm256_loadu_ps(s + j);
+		__m256 z = _mm256_div_ps(va, _mm256_sub_ps(vf, _mm256_mul_ps(w, vb)));
+		z = _mm256_and_ps(z, _mm256_cmp_ps(w, one, _CMP_LT_OQ));
+		_mm_storeu_si128((__m128i*)(d + j), _mm256_cvtps_ph(z, 0));
+	}
+	return j;
+}
+#endif
+
+// camera-space Z of the perspective projection glFrustum-like matrices produce:
+// z = 2fn / ((f+n) - (2d-1)(f-n)) = fn / (f - d(f-n))
+void encodeDepth(const float *src, int width, int height, float nearP, float farP,
+	DepthFormat format, float scale, cv::Mat &dst)
+{
+	CV_Assert(dst.type() == depthType(format) && dst.rows >= height && dst.cols >= width);
+
+	if (format == DEPTH_WINDOW)
+	{
+		for (int i = 0; i < height; ++i)
+			memcpy(dst.ptr<float>(height - i - 1), src + (size_t)i*width, width * sizeof(float));
+		return;
+	}
+
+	const float a = farP * nearP;
+	const float b = farP - nearP;
+#if PIXELOPS_SSE2
+	const bool sse2 = simdLevel() >= SIMD_SSE2;
+#endif
+#if PIXELOPS_TARGETS
+	const bool f16c = simdLevel() >= SIMD_F16C;
+#endif
+	for (int i = 0; i < height; ++i)
+	{
+		const float *s = src + (size_t)i*width;
+		int j = 0;
+
+		if (format == DEPTH_FLOAT)
+		{
+			float *d = dst.ptr<float>(height - i - 1);
+#if PIXELOPS_SSE2
+			const __m128 va = _mm_set1_ps(a), vb = _mm_set1_ps(b), vf = _mm_set1_ps(farP), one = _mm_set1_ps(1.0f);
+			for (; sse2 && j + 4 <= width; j += 4)
+			{
+				__m128 w = _mm_loadu_ps(s + j);
+				__m128 z = _mm_div_ps(va, _mm_sub_ps(vf, _mm_mul_ps(w, vb)));
+				_mm_storeu_ps(d + j, _mm_and_ps(z, _mm_cmplt_ps(w, one)));
+			}
+#endif
+			for (; j < width; ++j)
+				d[j] = s[j] < 1.0f ? a / (farP - s[j] * b) : 0.0f;
+		}
+		else if (format == DEPTH_UINT16)
+		{
+			unsigned short *d = dst.ptr<unsigned short>(height - i - 1);
+#if PIXELOPS_SSE2
+			// saturate to [0,65535] in float and round like cvRound, then pack through
+			// the signed range. The bias is taken off the integers, in float it would
+			// round away the fraction.
+			const __m128 va = _mm_set1_ps(a * scale), vb = _mm_set1_ps(b), vf = _mm_set1_ps(farP), one = _mm_set1_ps(1.0f);
+			const __m128 maxValue = _mm_set1_ps(65535.0f);
+			const __m128i bias = _mm_set1_epi32(32768);
+			const __m128i flip = _mm_set1_epi16((short)0x8000);
+			for (; sse2 && j + 8 <= width; j += 8)
+			{
+				__m128 w0 = _mm_loadu_ps(s + j), w1 = _mm_loadu_ps(s + j + 4);
+				__m128 z0 = _mm_div_ps(va, _mm_sub_ps(vf, _mm_mul_ps(w0, vb)));
+				__m128 z1 = _mm_div_ps(va, _mm_sub_ps(vf, _mm_mul_ps(w1, vb)));
+				z0 = _mm_and_ps(_mm_min_ps(z0, maxValue), _mm_cmplt_ps(w0, one));
+				z1 = _mm_and_ps(_mm_min_ps(z1, maxValue), _mm_cmplt_ps(w1, one));
+				__m128i i0 = _mm_sub_epi32(_mm_cvtps_epi32(z0), bias);
+				__m128i i1 = _mm_sub_epi32(_mm_cvtps_epi32(z1), bias);
+				_mm_storeu_si128((__m128i*)(d + j), _mm_xor_si128(_mm_packs_epi32(i0, i1), flip));
+			}
+#endif
+			for (; j < width; ++j)
+			{
+				float z = s[j] < 1.0f ? a * scale / (farP - s[j] * b) : 0.0f;
+				d[j] = (unsigned short)cvRound(std::min(z, 65535.0f));
+			}
+		}
+		else // DEPTH_HALF
+		{
+			unsigned short *d = dst.ptr<unsigned short>(height - i - 1);
+#if PIXELOPS_TARGETS
+			if (f16c)
+				j = encodeHalfRowF16C(s, d, width, a, b, farP);
+#endif
+			for (; j < width; ++j)
+				d[j] = s[j] < 1.0f ? floatToHalf(a / (farP - s[j] * b)) : 0;
+		}
+	}
+}
+
+}
@@ -0,0 +1,72 @@
+#ifndef _PIXEL_OPS_H_
+#define _PIXEL_OPS_H_
+
+#include <opencv2/opencv.hpp>
+
+// x86 kernels of pixelOps, glm and the marker detector. SSE2 is part of every x86-64 cpu
+// and used as built, wider kernels are compiled with PIXELOPS_TARGET and picked at run time
+// through pixelOps::simdLevel(). Define PIXELOPS_NO_SIMD to only build the plain loops.
+#if !defined(PIXELOPS_NO_SIMD) && (defined(__x86_64__) || defined(_M_X64) || \
+	(defined(__i386__) && defined(__SSE2__)) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define PIXELOPS_SSE2 1
+#if defined(_MSC_VER)
+#define PIXELOPS_TARGETS 1
+#define PIXELOPS_TARGET(isa)
+#elif defined(__clang__) || __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)
+#define PIXELOPS_TARGETS 1
+#define PIXELOPS_TARGET(isa) __attribute__((target(isa)))
+#endif
+#endif
+
+// pixel conversions between the OpenGL buffers and the OpenCV images,
+// GL rows are bottom-up, OpenCV rows are top-down
+namespace pixelOps
+{
+	// encodings of the depth map made from the window-space depth buffer
+	enum DepthFormat
+	{
+		DEPTH_WINDOW,                     // raw window-space depth in [0,1], CV_32FC1
+		DEPTH_FLOAT,                      // camera-space Z in model units, CV_32FC1
+		DEPTH_UINT16,                     // camera-space Z times scale, CV_16UC1
+		DEPTH_HALF                        // camera-space Z as IEEE half floats, CV_16UC1
+	};
+
+	// OpenCV type of a depth map in the given format
+	int depthType(DepthFormat format);
+
+	// encode height bottom-up rows of window-space depth into the top-down dst.
+	// nearP and farP are the planes of the perspective projection the depth was drawn with.
+	// Pixels without geometry (depth 1) are 0 in the metric formats.
+	// scale is the DEPTH_UINT16 step per model unit, e.g. 1000 for millimetres of a model in metres.
+	// DEPTH_FLOAT and DEPTH_UINT16 take SSE2, DEPTH_HALF takes F16C, each result
+	// is the same as the plain loop's.
+	void encodeDepth(const float *src, int width, int height, float nearP, float farP,
+		DepthFormat format, float scale, cv::Mat &dst);
+
+	// round a float to the nearest IEEE half float
+	unsigned short floatToHalf(float f);
+
+	// convert height bottom-up rows of RGBA pixels into the top-down BGR dst (CV_8UC3)
+	void rgbaToBgr(const unsigned char *src, int width, int height, cv::Mat &dst);
+
+	// alpha-blend height bottom-up rows of RGBA pixels over the top-down BGR dst (CV_8UC3) in place
+	void blendRgba(const unsigned char *src, int width, int height, cv::Mat &dst);
+
+	// instruction sets the kernels can use, each level includes the ones before
+	enum SimdLevel
+	{
+		SIMD_NONE,
+		SIMD_SSE2,
+		SIMD_SSSE3,
+		SIMD_F16C,                        // AVX with half float conversions
+		SIMD_AVX2
+	};
+
+	// widest level of the running cpu, checked once, capped by setSimdLimit()
+	int simdLevel();
+
+	// cap the instruction set, for benchmarks and checking the kernels against each other
+	void setSimdLimit(int level);
+}
+
+#endif